@@ -35,9 +35,10 @@ SOFTWARE.
 #include <WebServer.h>
 #include <DNSServer.h>
 #include <WiFiManager.h>          //https://github.com/tzapu/WiFiManager
-
+#include <SOL_board.h>
 
 #include "SOL.h"
+#include "SOL_adc.h"
 
 
 // TODO this API is unofficial and unsupported!
@@ -55,6 +56,10 @@ static uint8_t pswd_length;
 static char pswd[64];
 static uint32_t device_ID;
 
+// Board traits tables, defined here as well so they can be indexed at runtime
+constexpr float SOL_board_R1::V_SCALE[1];
+constexpr float SOL_board_R1::I_SCALE[1];
+
 
 /**
  * @brief Performs initialization for SOL
@@ -79,6 +84,9 @@ void SOL_begin()
 	digitalWrite(LED_PIN, LOW);
 	#endif
 
+	// ADC correction table, built on the first wake only
+	SOL_adcCalibrate();
+
 	// Set charge disable pin low
 	pinMode(CHG_DISABLE_PIN, OUTPUT);
 	digitalWrite(CHG_DISABLE_PIN, LOW);
@@ -92,6 +100,35 @@ void SOL_begin()
 	#endif
 }
 
+/**
+ * @brief Reads where the next record will be stored, emptying the data log if that is not a record slot
+ *
+ * 	Firmware before the shared log stored the last address written instead, which is never a
+ * 	slot, so the log is emptied once after an update rather than written out of alignment
+ *
+ * @return The address the next record will be stored at
+ */
+static uint16_t SOL_getNextStorageAddress(void)
+{
+	uint16_t next_storage_address;
+	SOL_readEEPROMNByte(EEPROM_ADDRESS_NEXT_STORAGE_ADDRESS, (uint8_t *) &next_storage_address, 2);
+
+	if(next_storage_address < EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS
+		|| next_storage_address + sizeof(data_packet_t) > EEPROM_ADDRESS_DATA_RANGE_END_ADDRESS
+		|| (next_storage_address - EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS) % sizeof(data_packet_t) != 0)
+	{
+		#ifdef SOL_DEBUG
+		Serial.print("Invalid next storage address, resetting data log: ");
+		Serial.println(next_storage_address);
+		#endif
+
+		next_storage_address = EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS;
+		SOL_writeEEPROMNByte(EEPROM_ADDRESS_NEXT_STORAGE_ADDRESS, (uint8_t *) &next_storage_address, 2);
+	}
+
+	return next_storage_address;
+}
+
 /**
  * @brief Manages SOL task upon wakeup, triggering data reading and uploading when necessary
  *
@@ -115,11 +152,8 @@ void SOL_task()
 		// Run power sweep, save data
 		SOL_generateDataPacket();
 
-		// Determine if it is time to upload data
-		uint16_t last_storage_address;
-		SOL_readEEPROMNByte(EEPROM_ADDRESS_LAST_STORAGE_ADDRESS, (uint8_t *)&last_storage_address, 2);
-
-		uint16_t datapoints = (last_storage_address - EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS) / sizeof(data_packet_t);
+		// Determine if it is time to upload data, the log always starts at the start of the range
+		uint16_t datapoints = SOL_logCount<SOL_board, data_packet_t>(SOL_getNextStorageAddress(), EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS);
 
 		#ifdef SOL_DEBUG
 		Serial.print("Number of datapoints: ");
@@ -292,6 +326,10 @@ void SOL_startProvisioning(void)
 		// Indicate wifi credentials available
 		SOL_writeEEPROMByte(EEPROM_ADDRESS_WIFI_CREDENTIALS_AVAILABLE, (uint8_t) 1);
 
+		// Reset next storage address, EEPROM may hold anything before the first provisioning
+		uint16_t next_storage = EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS;
+		SOL_writeEEPROMNByte(EEPROM_ADDRESS_NEXT_STORAGE_ADDRESS, (uint8_t *) &next_storage, 2);
+
 	}
 
 	#ifdef SOL_DEBUG
@@ -310,15 +348,14 @@ void SOL_upload(void)
 	digitalWrite(LED_PIN, HIGH);
 	#endif
 
-	// Check where was written last
-	uint16_t last_storage_address;
-	SOL_readEEPROMNByte(EEPROM_ADDRESS_LAST_STORAGE_ADDRESS, (uint8_t *)&last_storage_address, 2);
-	uint16_t first_storage_address = EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS + sizeof(data_packet_t); // TODO fix indexing issue
+	// Check how much data has been written since the last upload
+	uint16_t datapoints = SOL_logCount<SOL_board, data_packet_t>(SOL_getNextStorageAddress(), EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS);
 
-	for(uint16_t dp = first_storage_address; dp <= last_storage_address+1; dp += sizeof(data_packet_t))
+	uint16_t dp = EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS;
+	for(uint16_t i = 0; i < datapoints; i++, dp = SOL_logNext<SOL_board, data_packet_t>(dp))
 	{
 		// Get data from EEPROM
-		data_packet_t data = SOL_getDataPacket(dp-1); // TODO why the -1 needed?
+		data_packet_t data = SOL_getDataPacket(dp);
 
 		// Fix ID
 		data.ID = device_ID;
@@ -342,9 +379,9 @@ void SOL_upload(void)
 		SOL_uploadDataPacket(&data);
 	}
 
-	// Reset last storage address
-	uint16_t last_storage = EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS-1;
-	SOL_writeEEPROMNByte(EEPROM_ADDRESS_LAST_STORAGE_ADDRESS, (uint8_t *) &last_storage, 2);
+	// Reset next storage address
+	uint16_t next_storage = EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS;
+	SOL_writeEEPROMNByte(EEPROM_ADDRESS_NEXT_STORAGE_ADDRESS, (uint8_t *) &next_storage, 2);
 
 	#ifdef SOL_DEBUG
 	// Turn off LED
@@ -392,42 +429,30 @@ void SOL_generateDataPacket(void)
 	float max_current = 0.0;
 	float max_voltage = 0.0;
 
-	for (uint16_t i = 0; i < DAC_RANGE; i++)
+	#ifdef SOL_DMA_SWEEP
+	static int16_t voltage_raw[DAC_RANGE];
+	static int16_t current_raw[DAC_RANGE];
+
+	if(SOL_adcSweep(voltage_raw, current_raw, DAC_RANGE))
 	{
-	    // Sweep DAC
-	    dacWrite(DAC_PIN, i);
-	    delay(1);
-
-	    // Read raw ADC values
-	    int current_raw = analogRead(I_SENSE_PIN);
-	    int voltage_raw = analogRead(V_SENSE_PIN);
-
-	    // Convert to volts
-	    float voltage = ((float) voltage_raw / (float) ADC_RANGE) * (float) V_SENSE_RANGE;
-	    voltage = voltage * 3.0; // TODO use real gain
-
-	    // Convert to amps
-	    float current = ((float) current_raw / (float) ADC_RANGE) * (float) I_SENSE_RANGE; // Real volts measured
-	    current = current / R_SENSE ; // Ohms law I = V/R
-	    current = current / I_SENSE_AMPLIFICATION;
-
-	    float power = current * voltage;
-
-	    if (power > max_power)
-	    {
-	      max_power = power;
-	    }
-
-	    if (current > max_current)
-	    {
-	      max_current = current;
-	    }
-
-	    if (voltage > max_voltage)
-	    {
-	      max_voltage = voltage;
-	    }
-  	}
+		SOL_sweep_max_t max;
+		SOL_sweepMaxReset(&max);
+
+		for(uint16_t i = 0; i < DAC_RANGE; i++)
+		{
+			SOL_sweepMaxAdd(&max, voltage_raw[i], current_raw[i]);
+		}
+
+		SOL_sweepMaxToUnits(&max, SOL_board::V_SCALE[0], SOL_board::I_SCALE[0], &max_power, &max_current, &max_voltage);
+	}
+	else
+	{
+		// I2S driver unavailable, sweep one point at a time instead
+		SOL_sweepFull<SOL_board>(&max_power, &max_current, &max_voltage);
+	}
+	#else
+	SOL_sweepFull<SOL_board>(&max_power, &max_current, &max_voltage);
+	#endif
 
 	// Get temperature
 	float temp_C = (temprature_sens_read() - 32) / 1.8;
@@ -457,25 +482,62 @@ void SOL_generateDataPacket(void)
 	#endif
 
 	// Determine where to save data
-	uint16_t new_storage_address;
-	SOL_readEEPROMNByte(EEPROM_ADDRESS_LAST_STORAGE_ADDRESS, (uint8_t *) &new_storage_address, 2);
-	new_storage_address += sizeof(data_packet_t);
+	uint16_t next_storage_address = SOL_getNextStorageAddress();
 
-	// Prevent attempt to write past available space, start overwriting oldest data
-	// TODO this will confuse the upload function...
-	if(new_storage_address + sizeof(data_packet_t) >= EEPROM_ADDRESS_DATA_RANGE_END_ADDRESS)
+	// There is no tail to move, so a full log keeps its data until it is uploaded instead of wrapping
+	// back to the start, which would read as empty
+	if(SOL_logCount<SOL_board, data_packet_t>(next_storage_address, EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS) >= SOL_logCapacity<SOL_board, data_packet_t>())
 	{
-		new_storage_address = EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS;
+		#ifdef SOL_DEBUG
+		Serial.println("Data log full, datapoint dropped");
+		#endif
+		return;
 	}
 
 	#ifdef SOL_DEBUG
 	Serial.print("New datapoint address: ");
-	Serial.println(new_storage_address);
+	Serial.println(next_storage_address);
 	#endif
 
 	// Save data and location of it
-	SOL_writeEEPROMNByte(new_storage_address, (uint8_t *) &data, sizeof(data_packet_t));
-	SOL_writeEEPROMNByte(EEPROM_ADDRESS_LAST_STORAGE_ADDRESS, (uint8_t *) &new_storage_address, 2);
+	SOL_writeEEPROMNByte(next_storage_address, (uint8_t *) &data, sizeof(data_packet_t));
+	next_storage_address = SOL_logNext<SOL_board, data_packet_t>(next_storage_address);
+	SOL_writeEEPROMNByte(EEPROM_ADDRESS_NEXT_STORAGE_ADDRESS, (uint8_t *) &next_storage_address, 2);
+}
+
+/**
+ * @brief Reads the raw panel voltage and current ADC counts at one DAC setting
+ *
+ * @param dac The DAC value setting the load
+ * @param v_gain_idx Unused, the ESP32 ADC is read at one attenuation
+ * @param i_gain_idx Unused, the ESP32 ADC is read at one attenuation
+ * @param voltage_raw Pointer to put the voltage reading in
+ * @param current_raw Pointer to put the current reading in
+ *
+ */
+void SOL_board_R1::readPointRaw(uint8_t dac, uint8_t v_gain_idx, uint8_t i_gain_idx, int16_t * voltage_raw, int16_t * current_raw)
+{
+	// Sweep DAC
+	dacWrite(DAC_PIN, dac);
+	delay(1);
+
+	// Read until both means settle, so sense amplifier noise does not set the maxima
+	SOL_oversample_t current;
+	SOL_oversample_t voltage;
+	SOL_oversampleReset(&current);
+	SOL_oversampleReset(&voltage);
+
+	do
+	{
+		SOL_oversampleAdd(&current, analogRead(I_SENSE_PIN));
+		SOL_oversampleAdd(&voltage, analogRead(V_SENSE_PIN));
+	} while(current.count < OVERSAMPLE_MAX_READS
+		&& !(SOL_oversampleConverged(&current, OVERSAMPLE_MIN_READS, OVERSAMPLE_TOLERANCE_COUNTS)
+			&& SOL_oversampleConverged(&voltage, OVERSAMPLE_MIN_READS, OVERSAMPLE_TOLERANCE_COUNTS)));
+
+	// Corrected the same way as a DMA sweep
+	*current_raw = SOL_adcCorrect(SOL_oversampleMean(&current));
+	*voltage_raw = SOL_adcCorrect(SOL_oversampleMean(&voltage));
 }
 
 /**
@@ -583,10 +645,7 @@ void SOL_writeEEPROMByte(uint16_t address, uint8_t data)
  */
 void SOL_writeEEPROMNByte(uint16_t address, uint8_t * data, uint16_t size)
 {
-	for(uint16_t i = 0; i < size; i++)
-	{
-		SOL_writeEEPROMByte(address+i, *(data+i));
-	}
+	SOL_eepromWrite<SOL_board>(address, data, size);
 }
 
 /**
@@ -618,10 +677,5 @@ uint8_t SOL_readEEPROMByte(uint16_t address)
  */
 void SOL_readEEPROMNByte(uint16_t address, uint8_t * data, uint16_t size)
 {
-	// TODO make faster version by request consecutive data
-
-	for(uint16_t i = 0; i < size; i++)
-	{
-		data[i] = SOL_readEEPROMByte(address+i);
-	}
+	SOL_eepromRead<SOL_board>(address, data, size);
 }
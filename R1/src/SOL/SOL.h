@@ -33,6 +33,8 @@ SOFTWARE.
 #ifndef SOL_h
 #define SOL_h
 
+#include <SOL_sweep.h>
+
 //#define SOL_DEBUG
 
 //Define I2C addresses
@@ -53,6 +55,24 @@ SOFTWARE.
 #define I_SENSE_RANGE        							3.9					// ESP32 ADC max voltage
 #define I_SENSE_AMPLIFICATION							101.0				// Amplification stage for current sensing
 #define R_SENSE              							0.75				// Current sense resistance, Ohms
+#define V_SENSE_AMPLIFICATION							3.0					// TODO use real gain
+#define V_SENSE_CHANNEL									ADC1_CHANNEL_4		// ADC channel of V_SENSE_PIN
+#define I_SENSE_CHANNEL									ADC1_CHANNEL_6		// ADC channel of I_SENSE_PIN
+
+// Sweep with the I2S ADC DMA, a full sweep takes at least DAC_RANGE * 2 * DMA_SAMPLES_PER_STEP / DMA_SAMPLE_RATE seconds
+#define SOL_DMA_SWEEP													// Comment out to sweep with analogRead
+#define DMA_SAMPLE_RATE									320000				// ADC samples per second
+#define DMA_SAMPLES_PER_STEP							16					// Samples per DAC step, one DMA buffer
+#define DMA_SETTLE_SAMPLES								8					// Samples dropped after each step while the load settles
+#define DMA_BUFFER_COUNT								4					// DMA buffers queued by the I2S driver
+#define DMA_EVENT_QUEUE_SIZE							8					// I2S driver events queued, counted to catch buffers the sweep fell behind on
+#define ADC_LUT_STEP_SHIFT								6					// Raw counts between ADC correction table entries, as a power of 2
+
+// Oversampling, each point is read until the standard error of its mean is below the tolerance
+#define OVERSAMPLE_MIN_READS							4					// Readings per point before stopping early
+#define OVERSAMPLE_MAX_READS							32					// Readings per point with analogRead, 1 disables oversampling
+#define OVERSAMPLE_TOLERANCE_COUNTS						2.0					// Standard error of the mean to stop at, ADC counts
+#define DMA_MAX_BUFFERS_PER_STEP						4					// DMA buffers per point before giving up on converging
 
 #define EEPROM_ADDRESS_WIFI_CREDENTIALS_AVAILABLE		0x0000				// Location for flag if WiFi credentials have been sent
 #define EEPROM_ADDRESS_WIFI_SSID_START					0x0001				// Location of start of WiFi SSID
@@ -61,7 +81,7 @@ SOFTWARE.
 #define EEPROM_ADDRESS_WIFI_PSWD_END					0x006A				// Location of end of WiFi password
 #define EEPROM_ADDRESS_WIFI_SSID_LENGTH					0x006B				// Location of length of WiFi SSID length (# of chars)
 #define EEPROM_ADDRESS_WIFI_PSWD_LENGTH					0x006C				// Location of length of WiFi PSWD length (# of chars)
-#define EEPROM_ADDRESS_LAST_STORAGE_ADDRESS				0x006D				// Location of information about where data was stored last (also takes 0x006E)
+#define EEPROM_ADDRESS_NEXT_STORAGE_ADDRESS				0x006D				// Location of address where next data will be stored (also takes 0x006E)
 #define EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS 		0x006F				// Location of start of data address
 #define EEPROM_ADDRESS_DATA_RANGE_END_ADDRESS 			0x4000				// Last location available in 128kbit EEPROM
 
@@ -86,6 +106,38 @@ typedef struct data_packet_t
 	uint32_t ID;
 } data_packet_t;
 
+/**
+ * @brief Board traits for R1, specializing the shared firmware core in SOL_board.h
+ */
+struct SOL_board_R1
+{
+	static constexpr uint8_t EEPROM_I2C_ADDRESS = EEPROM_ADDRESS;
+	static constexpr uint16_t EEPROM_PAGE_SIZE = 64;					// 24LC128
+	static constexpr uint8_t EEPROM_WRITE_MS = 5;
+	static constexpr uint16_t LOG_START = EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS;
+	static constexpr uint16_t LOG_END = EEPROM_ADDRESS_DATA_RANGE_END_ADDRESS;
+	static constexpr bool HAS_RTC = false;
+	static constexpr uint16_t DAC_STEPS = DAC_RANGE;
+	static constexpr uint8_t SWEEP_GAIN_COUNT = 1;
+
+	// Volts and amps per ESP32 ADC count, the ADC is read at one attenuation
+	static constexpr float V_SCALE[1] = {SOL_voltsPerCount(V_SENSE_RANGE, ADC_RANGE, V_SENSE_AMPLIFICATION)};
+	static constexpr float I_SCALE[1] = {SOL_ampsPerCount(I_SENSE_RANGE, ADC_RANGE, R_SENSE, I_SENSE_AMPLIFICATION)};
+
+	/**
+	 * @brief Reads the raw panel voltage and current ADC counts at one DAC setting
+	 *
+	 * @param dac The DAC value setting the load
+	 * @param v_gain_idx Unused, the ESP32 ADC is read at one attenuation
+	 * @param i_gain_idx Unused, the ESP32 ADC is read at one attenuation
+	 * @param voltage_raw Pointer to put the voltage reading in
+	 * @param current_raw Pointer to put the current reading in
+	 *
+	 */
+	static void readPointRaw(uint8_t dac, uint8_t v_gain_idx, uint8_t i_gain_idx, int16_t * voltage_raw, int16_t * current_raw);
+};
+typedef SOL_board_R1 SOL_board;
+
 /**
  * @brief Performs initialization for SOL
  *
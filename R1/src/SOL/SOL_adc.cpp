@@ -0,0 +1,266 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_adc.cpp
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Fast I-V sweeps for SOL with the I2S ADC DMA, and calibrated correction of ESP32 ADC readings
+ */
+
+#include <Arduino.h>
+#include <driver/adc.h>
+#include <driver/i2s.h>
+#include <esp_adc_cal.h>
+
+#include "SOL.h"
+#include "SOL_adc.h"
+
+#define ADC_LUT_SIZE			((ADC_RANGE >> ADC_LUT_STEP_SHIFT) + 2)
+#define ADC_DEFAULT_VREF_MV		1100				// Used if the eFuse holds no Vref
+
+static_assert(V_SENSE_RANGE == I_SENSE_RANGE, "Both sense inputs share one ADC correction table");
+
+// Corrected reading at every 2^ADC_LUT_STEP_SHIFT raw counts, kept through deep sleep
+RTC_DATA_ATTR uint16_t adc_lut[ADC_LUT_SIZE];
+RTC_DATA_ATTR uint8_t adc_lut_ready = 0;
+
+/**
+ * @brief Builds the ADC correction table from the eFuse calibration, once per power on
+ *
+ */
+void SOL_adcCalibrate(void)
+{
+	if(adc_lut_ready)
+	{
+		return;
+	}
+
+	esp_adc_cal_characteristics_t chars;
+	esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, ADC_DEFAULT_VREF_MV, &chars);
+
+	for(uint16_t i = 0; i < ADC_LUT_SIZE; i++)
+	{
+		uint32_t raw = (uint32_t) i << ADC_LUT_STEP_SHIFT;
+		if(raw > ADC_RANGE)
+		{
+			raw = ADC_RANGE;
+		}
+
+		// Scale millivolts back to counts of an ideal ADC, so the board's scale factors still apply
+		float ideal = esp_adc_cal_raw_to_voltage(raw, &chars) * (ADC_RANGE / (V_SENSE_RANGE * 1000.0));
+		adc_lut[i] = (ideal > ADC_RANGE) ? ADC_RANGE : (uint16_t) ideal;
+	}
+
+	adc_lut_ready = 1;
+}
+
+/**
+ * @brief Corrects the nonlinearity of a raw ESP32 ADC reading with the correction table
+ *
+ * @param raw The raw reading, 0 to ADC_RANGE
+ *
+ * @return The reading an ideal ADC with the same full scale would give
+ */
+int16_t SOL_adcCorrect(int16_t raw)
+{
+	if(!adc_lut_ready)
+	{
+		return raw;
+	}
+
+	// Interpolate between the table entries either side
+	uint16_t idx = raw >> ADC_LUT_STEP_SHIFT;
+	int32_t frac = raw & ((1 << ADC_LUT_STEP_SHIFT) - 1);
+	int32_t low = adc_lut[idx];
+	int32_t high = adc_lut[idx + 1];
+
+	return (int16_t) (low + (((high - low) * frac) >> ADC_LUT_STEP_SHIFT));
+}
+
+/**
+ * @brief Counts the DMA buffers the I2S driver completed since it was last asked
+ *
+ * @param events The I2S driver event queue
+ * @param completed Pointer to the count to add to
+ *
+ * @return 1 if no DMA error was reported, otherwise 0
+ */
+static uint8_t SOL_adcCountBuffers(QueueHandle_t events, uint32_t * completed)
+{
+	i2s_event_t event;
+	while(xQueueReceive(events, &event, 0) == pdTRUE)
+	{
+		if(event.type == I2S_EVENT_RX_DONE)
+		{
+			(*completed)++;
+		}
+		else if(event.type == I2S_EVENT_DMA_ERROR)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+ * @brief Sweeps the DAC while the I2S ADC samples one channel
+ *
+ * 	Each step is only matched to its buffers while the sweep keeps up with the DMA. Buffers the
+ * 	driver completed are counted against buffers read, and the sweep fails as soon as a completed
+ * 	buffer is waiting when the DAC is stepped, since it was sampled at the old step, or once the
+ * 	driver dropped buffers.
+ *
+ * @param channel The ADC1 channel to sample
+ * @param events The I2S driver event queue
+ * @param raw Array of steps corrected readings to fill
+ * @param steps The number of DAC steps, from 0
+ *
+ * @return 1 if the sweep completed, otherwise 0
+ */
+static uint8_t SOL_adcSweepChannel(adc1_channel_t channel, QueueHandle_t events, int16_t * raw, uint16_t steps)
+{
+	if(i2s_set_adc_mode(ADC_UNIT_1, channel) != ESP_OK || i2s_adc_enable(I2S_NUM_0) != ESP_OK)
+	{
+		return 0;
+	}
+
+	uint16_t buffer[DMA_SAMPLES_PER_STEP];
+	size_t bytes_read;
+	uint8_t success = 1;
+
+	// Set the first step, then drop everything sampled so far
+	dacWrite(DAC_PIN, 0);
+	do
+	{
+		i2s_read(I2S_NUM_0, buffer, sizeof(buffer), &bytes_read, 0);
+	} while(bytes_read == sizeof(buffer));
+
+	// The buffer being filled now started before the DAC was set, buffers are counted from the next
+	i2s_read(I2S_NUM_0, buffer, sizeof(buffer), &bytes_read, portMAX_DELAY);
+	xQueueReset(events);
+	uint32_t completed = 0;
+	uint32_t consumed = 0;
+
+	for(uint16_t dac = 0; dac < steps && success; dac++)
+	{
+		SOL_oversample_t acc;
+		SOL_oversampleReset(&acc);
+		uint8_t first = DMA_SETTLE_SAMPLES;
+		uint8_t buffers = 0;
+
+		// Stay on this step for more buffers while the mean is still noisy
+		do
+		{
+			// Blocks until the buffer that started just before this step completes
+			if(i2s_read(I2S_NUM_0, buffer, sizeof(buffer), &bytes_read, portMAX_DELAY) != ESP_OK || bytes_read != sizeof(buffer))
+			{
+				success = 0;
+				break;
+			}
+			consumed++;
+
+			// Samples hold the channel in the top 4 bits
+			for(uint8_t i = first; i < DMA_SAMPLES_PER_STEP; i++)
+			{
+				SOL_oversampleAdd(&acc, buffer[i] & 0x0FFF);
+			}
+
+			first = 0;
+			buffers++;
+		} while(buffers < DMA_MAX_BUFFERS_PER_STEP
+			&& !SOL_oversampleConverged(&acc, OVERSAMPLE_MIN_READS, OVERSAMPLE_TOLERANCE_COUNTS));
+
+		// Every buffer read so far must be every buffer completed, or the next one holds the old step
+		if(!success || !SOL_adcCountBuffers(events, &completed) || completed != consumed)
+		{
+			success = 0;
+			break;
+		}
+
+		// Step the load right away, the next buffer is already filling
+		if(dac + 1 < steps)
+		{
+			dacWrite(DAC_PIN, dac + 1);
+		}
+
+		raw[dac] = SOL_adcCorrect(SOL_oversampleMean(&acc));
+	}
+
+	i2s_adc_disable(I2S_NUM_0);
+	return success;
+}
+
+/**
+ * @brief Sweeps the DAC, sampling panel voltage and current with the I2S ADC DMA
+ *
+ * 	The DAC is stepped when a DMA buffer completes, so every buffer holds the samples of one
+ * 	step. The first DMA_SETTLE_SAMPLES of each step are dropped while the load settles and the
+ * 	rest are averaged, reading up to DMA_MAX_BUFFERS_PER_STEP buffers until the mean
+ * 	converges. The sweep fails if it falls behind the DMA, rather than use buffers from the
+ * 	wrong step.
+ *
+ * 	Voltage and current are swept one after the other, since the I2S ADC samples one channel.
+ * 	The two readings at a step are therefore a whole sweep apart, at least
+ * 	DAC_RANGE * DMA_SAMPLES_PER_STEP / DMA_SAMPLE_RATE seconds, about 13ms, and power assumes
+ * 	the light on the panel did not change in between.
+ *
+ * @param voltage_raw Array of steps corrected voltage readings to fill
+ * @param current_raw Array of steps corrected current readings to fill
+ * @param steps The number of DAC steps, from 0
+ *
+ * @return 1 if the sweep completed, 0 if the I2S driver failed or the sweep fell behind, and analogRead should be used instead
+ */
+uint8_t SOL_adcSweep(int16_t * voltage_raw, int16_t * current_raw, uint16_t steps)
+{
+	i2s_config_t config;
+	memset(&config, 0, sizeof(config));
+	config.mode = (i2s_mode_t) (I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN);
+	config.sample_rate = DMA_SAMPLE_RATE;
+	config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+	config.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+	config.communication_format = I2S_COMM_FORMAT_I2S_MSB;
+	config.dma_buf_count = DMA_BUFFER_COUNT;
+	config.dma_buf_len = DMA_SAMPLES_PER_STEP;
+
+	QueueHandle_t events;
+	if(i2s_driver_install(I2S_NUM_0, &config, DMA_EVENT_QUEUE_SIZE, &events) != ESP_OK)
+	{
+		return 0;
+	}
+
+	// Same range analogRead uses, which the board scale factors assume
+	adc1_config_width(ADC_WIDTH_BIT_12);
+	adc1_config_channel_atten(V_SENSE_CHANNEL, ADC_ATTEN_DB_11);
+	adc1_config_channel_atten(I_SENSE_CHANNEL, ADC_ATTEN_DB_11);
+
+	uint8_t success = SOL_adcSweepChannel(V_SENSE_CHANNEL, events, voltage_raw, steps)
+		&& SOL_adcSweepChannel(I_SENSE_CHANNEL, events, current_raw, steps);
+
+	// Give ADC1 back to analogRead
+	i2s_driver_uninstall(I2S_NUM_0);
+	dacWrite(DAC_PIN, 0);
+
+	return success;
+}
@@ -0,0 +1,75 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_adc.h
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Fast I-V sweeps for SOL with the I2S ADC DMA, and calibrated correction of ESP32 ADC readings
+ */
+
+
+#ifndef SOL_adc_h
+#define SOL_adc_h
+
+#include <Arduino.h>
+
+/**
+ * @brief Builds the ADC correction table from the eFuse calibration, once per power on
+ *
+ */
+void SOL_adcCalibrate(void);
+
+/**
+ * @brief Corrects the nonlinearity of a raw ESP32 ADC reading with the correction table
+ *
+ * @param raw The raw reading, 0 to ADC_RANGE
+ *
+ * @return The reading an ideal ADC with the same full scale would give
+ */
+int16_t SOL_adcCorrect(int16_t raw);
+
+/**
+ * @brief Sweeps the DAC, sampling panel voltage and current with the I2S ADC DMA
+ *
+ * 	The DAC is stepped when a DMA buffer completes, so every buffer holds the samples of one
+ * 	step. The first DMA_SETTLE_SAMPLES of each step are dropped while the load settles and the
+ * 	rest are averaged, reading up to DMA_MAX_BUFFERS_PER_STEP buffers until the mean
+ * 	converges. The sweep fails if it falls behind the DMA, rather than use buffers from the
+ * 	wrong step.
+ *
+ * 	Voltage and current are swept one after the other, since the I2S ADC samples one channel.
+ * 	The two readings at a step are therefore a whole sweep apart, at least
+ * 	DAC_RANGE * DMA_SAMPLES_PER_STEP / DMA_SAMPLE_RATE seconds, about 13ms, and power assumes
+ * 	the light on the panel did not change in between.
+ *
+ * @param voltage_raw Array of steps corrected voltage readings to fill
+ * @param current_raw Array of steps corrected current readings to fill
+ * @param steps The number of DAC steps, from 0
+ *
+ * @return 1 if the sweep completed, 0 if the I2S driver failed or the sweep fell behind, and analogRead should be used instead
+ */
+uint8_t SOL_adcSweep(int16_t * voltage_raw, int16_t * current_raw, uint16_t steps);
+
+#endif
@@ -36,17 +36,29 @@ SOFTWARE.
 #include <WiFiManager.h>          //https://github.com/tzapu/WiFiManager
 #include <Adafruit_ADS1015.h>
 #include <mcp7940_sol.h>
+#include <SOL_board.h>
 
 #include "time.h"
 
 #include "SOL_V2.h"
+#include "SOL_phase.h"
+#include "SOL_trace.h"
+#include "SOL_schedule.h"
+#include "SOL_time.h"
+#include "SOL_summary.h"
+#include "SOL_power.h"
+#include "SOL_storage.h"
+#include "SOL_config.h"
+#include "SOL_ota.h"
 
 const char* ntpServer = "pool.ntp.org";
 const long  gmtOffset_sec = 0;
 const int   daylightOffset_sec = 0;
 
 RTC_DATA_ATTR uint32_t sleepCount = 0;
-RTC_DATA_ATTR uint32_t lastNTPTime = 0;
+RTC_DATA_ATTR uint8_t rtcTimeSet = 0;			// MCP7940 holds wall clock time, so alarms can be used
+RTC_DATA_ATTR uint8_t curveCaptured = 0;
+RTC_DATA_ATTR uint32_t curveRawTime = 0;		// SOL_getRawTime of the last I-V curve capture
 
 static uint16_t last_write_address;
 static uint8_t ssid_length;
@@ -57,7 +69,16 @@ static uint32_t device_ID;
 static Adafruit_ADS1015 ads;
 
 static adsGain_t ADC_gains[5] = {GAIN_ONE, GAIN_TWO, GAIN_FOUR, GAIN_EIGHT, GAIN_SIXTEEN};
-static float ADC_max_v[5] = {4.096, 2.048, 1.024, 0.512, 0.256};
+
+#ifdef SOL_REF_CELLS
+static_assert(REF_CELL_COUNT <= (1 << REF_CELL_MUX_BITS), "Too many reference cells for the mux select lines");
+static const uint8_t ref_cell_mux_pins[] = REF_CELL_MUX_PINS;
+static const float ref_cell_w_m2_per_v[REF_CELL_COUNT] = REF_CELL_W_M2_PER_V;
+#endif
+
+// Board traits tables, defined here as well so they can be indexed at runtime
+constexpr float SOL_board_R2::V_SCALE[5];
+constexpr float SOL_board_R2::I_SCALE[5];
 
 /**
  * @brief Handles touch sensor input
@@ -65,10 +86,139 @@ static float ADC_max_v[5] = {4.096, 2.048, 1.024, 0.512, 0.256};
  */
 static void SOL_handletouch(void)
 {
-	#ifdef SOL_DEBUG
-	Serial.println("Touch sensed");
+	SOL_TRACE_DEBUG(SOL_TRACE_TOUCH, 0, 0);
+}
+
+/**
+ * @brief Checks if this wake is a scheduled one, from the timer or the RTC alarm
+ *
+ * @return 1 if scheduled, otherwise 0
+ */
+static uint8_t SOL_scheduledWake(void)
+{
+	esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
+	return (cause == ESP_SLEEP_WAKEUP_TIMER) || (cause == ESP_SLEEP_WAKEUP_EXT1);
+}
+
+/**
+ * @brief Sets up the wakeup sources for deep sleep
+ *
+ * 	With SOL_RTC_ALARM_WAKE, wakes on the MCP7940 alarm at a wall clock boundary once
+ * 	the RTC holds the time. The ESP32 timer stays as a backstop in case the alarm is missed.
+ *
+ * @param len The time to sleep in seconds
+ *
+ * @return The time that will actually be slept in seconds
+ */
+static uint32_t SOL_setWakeup(uint32_t len)
+{
+	// Touch pad wakeup configuration is kept in the RTC domain through deep sleep
+	esp_sleep_enable_touchpad_wakeup();
+
+	#ifdef SOL_RTC_ALARM_WAKE
+	if(rtcTimeSet)
+	{
+		// Align to the boundary at or after the requested time
+		uint32_t now = SOL_getTime();
+		uint32_t wake = now + len;
+		wake += (RTC_ALARM_ALIGN_SECONDS - (wake % RTC_ALARM_ALIGN_SECONDS)) % RTC_ALARM_ALIGN_SECONDS;
+		len = wake - now;
+
+		// This may be the first I2C access on this wake
+		Wire.begin(SDA_PIN,SCL_PIN,400000);
+		setRTCAlarmEpoch(wake);
+
+		esp_sleep_enable_ext1_wakeup(1ULL << RTC_MFP_PIN, ESP_EXT1_WAKEUP_ALL_LOW);
+		esp_sleep_enable_timer_wakeup((uint64_t) (len + RTC_ALARM_BACKSTOP_SECONDS) * 1000000);
+
+		SOL_TRACE_DEBUG(SOL_TRACE_RTC_ALARM, wake, len);
+		return len;
+	}
+	#endif
+
+	esp_sleep_enable_timer_wakeup((uint64_t) len * 1000000);
+	return len;
+}
+
+/**
+ * @brief Enters deep sleep right away, without touching any peripherals
+ *
+ * @param len The time to sleep in seconds
+ *
+ */
+static void SOL_quickSleep(uint32_t len)
+{
+	#ifdef SOL_OTA
+	SOL_otaRollback();
+	#endif
+
+	sleepCount = sleepCount + 1;
+	SOL_enterPhase(SOL_PHASE_SLEEP);
+	SOL_timeSleep(SOL_setWakeup(len));
+	SOL_phaseFinish();
+	esp_deep_sleep_start();
+}
+
+/**
+ * @brief Ends a wake that used up WAKE_BUDGET_MS, called from the esp_timer task
+ *
+ * 	The main task may be stuck in a driver holding I2C, so only RTC domain state is touched.
+ * 	Records are written before the log head moves, so a cut off write loses only that sample.
+ */
+static void SOL_budgetSleep(void)
+{
+	#ifdef SOL_OTA
+	// Unconfirmed firmware is aborted by the bootloader after a reset, which also loads RTC memory afresh
+	if(SOL_otaUnconfirmed())
+	{
+		esp_restart();
+	}
 	#endif
-	uint8_t dummy = 0;
+
+	sleepCount = sleepCount + 1;
+	esp_sleep_enable_touchpad_wakeup();
+	esp_sleep_enable_timer_wakeup((uint64_t) WAKE_OVERRUN_SLEEP_SECONDS * 1000000);
+	SOL_timeSleep(WAKE_OVERRUN_SLEEP_SECONDS);
+	SOL_phaseFinish();
+	esp_deep_sleep_start();
+}
+
+/**
+ * @brief Goes straight back to sleep after a timer wakeup if the panel is dark
+ *
+ * 	Checks the solar schedule first, which needs no peripherals at all. Otherwise takes a single
+ * 	open circuit voltage reading before any other peripheral is brought up, so night wakes skip
+ * 	UART, touch, RTC setup, credential loading and the full sweep.
+ */
+static void SOL_nightSkip(void)
+{
+	if(!SOL_scheduledWake())
+	{
+		return;
+	}
+
+	uint32_t now = SOL_getTime();
+	if(SOL_scheduleIsNight(now))
+	{
+		uint32_t len = SOL_scheduleNextSleep(now);
+		SOL_TRACE_INFO(SOL_TRACE_NIGHT_SKIP, 0, len);
+		SOL_quickSleep(len);
+	}
+
+	Wire.begin(SDA_PIN,SCL_PIN,400000);
+
+	// DAC at zero leaves the panel unloaded, so this is the open circuit voltage
+	dacWrite(DAC_PIN, 0);
+	ads.setGain(GAIN_ONE);
+	float voc = ads.readADC_SingleEnded(1) * SOL_board::V_SCALE[0];
+
+	if(voc >= NIGHT_VOC_THRESHOLD_V)
+	{
+		return;
+	}
+
+	SOL_TRACE_INFO(SOL_TRACE_NIGHT_SKIP, SOL_traceFloat(voc), SOL_config()->night_sleep_s);
+	SOL_quickSleep(SOL_config()->night_sleep_s);
 }
 
 /**
@@ -78,6 +228,14 @@ static void SOL_handletouch(void)
  */
 void SOL_begin()
 {
+	SOL_phaseInit();
+	SOL_traceBegin();
+	SOL_phaseStartBudget(SOL_budgetSleep);
+
+	// Nothing else is needed on a dark timer wakeup
+	SOL_nightSkip();
+
+	// Serial is only started when needed, printing costs real time on every wake
 	#ifdef SOL_DEBUG
 	Serial.begin(115200);
 	#endif
@@ -105,12 +263,28 @@ void SOL_begin()
 	ads.setGain(GAIN_ONE);  // 1x gain   +/- 4.096V  1 bit = 2mV
 	ads.begin();
 
+	// Set up data log
+	SOL_storageBegin();
+
 	// Set up RTC
-	RTCSetup();
+	if(SOL_board::HAS_RTC)
+	{
+		RTCSetup();
+	}
 
-	#ifdef SOL_DEBUG
-	Serial.println("Starting up");
-	#endif
+	// The RTC crystal drifts far less than the ESP32 slow clock, so correct from it every wake
+	if(SOL_board::HAS_RTC && rtcTimeSet)
+	{
+		uint32_t rtc_time = getRTCTime();
+		if(rtc_time != 0)
+		{
+			SOL_timeCorrect(rtc_time, SOL_TIME_SOURCE_RTC);
+		}
+		else
+		{
+			rtcTimeSet = 0;
+		}
+	}
 }
 
 /**
@@ -119,58 +293,97 @@ void SOL_begin()
  */
 void SOL_task()
 {
-	#ifdef SOL_DEBUG
-	Serial.println("Running Task");
-	#endif
-
 	sleepCount = sleepCount + 1;
 
 	esp_sleep_wakeup_cause_t wakeup_reason;
   	wakeup_reason = esp_sleep_get_wakeup_cause();
+  	SOL_TRACE_INFO(SOL_TRACE_BOOT, wakeup_reason, sleepCount);
+
 	if(wakeup_reason == ESP_SLEEP_WAKEUP_TOUCHPAD)
 	{
-		#ifdef SOL_DEBUG
-		Serial.println("Starting provisioning");
+		// Someone is at the device, so dump the trace log before provisioning
+		#ifndef SOL_DEBUG
+		Serial.begin(115200);
 		#endif
+		SOL_traceDump();
+
+		// Provisioning waits on a person, so only its own timeout applies
+		SOL_phaseStopBudget();
+
+		SOL_TRACE_INFO(SOL_TRACE_PROVISION_START, 0, 0);
+		SOL_enterPhase(SOL_PHASE_CONNECT);
 		SOL_startProvisioning();
 	}
-
-	// If not provisioned yet, don't save data
-	else if( SOL_hasWiFiCredentials() )
+	else
 	{
-		// Run power sweep, save data
-		SOL_generateDataPacket();
+		// If not provisioned yet, don't save data
+		SOL_enterPhase(SOL_PHASE_CREDENTIALS);
+		if(SOL_hasWiFiCredentials())
+		{
+			float batt_v = get_battery_voltage();
+			uint8_t charging = SOL_chargeAllowed(get_temperature_C()) && SOL_scheduleLastPower() > SOL_config()->charge_min_power_mW;
+			SOL_power_mode_t mode = SOL_powerUpdate(batt_v, charging);
+
+			// In survival mode, every bit of charge goes to getting the battery back
+			if(mode != SOL_POWER_SURVIVAL)
+			{
+				// Run power sweep, save data
+				SOL_generateDataPacket();
+			}
 
-		// Determine if it is time to upload data
-		uint16_t next_storage_address;
-		SOL_readEEPROMNByte(EEPROM_ADDRESS_NEXT_STORAGE_ADDRESS, (uint8_t *)&next_storage_address, 2);
+			// Determine if it is time to upload data
+			#ifdef SOL_UPLOAD_SUMMARIES_ONLY
+			// A finished day is worth uploading on its own
+			uint32_t datapoints = SOL_summaryPendingCount();
+			uint32_t capacity = SUMMARY_PENDING_COUNT;
+			uint32_t minimum = 1;
+			#else
+			uint32_t datapoints = SOL_storageCount();
+			uint32_t capacity = SOL_storageCapacity();
+			uint32_t minimum = SOL_config()->send_count;
+			#endif
 
-		uint16_t datapoints = (next_storage_address - EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS) / sizeof(data_packet_t);
+			SOL_TRACE_INFO(SOL_TRACE_DATAPOINTS, datapoints, 0);
 
-		#ifdef SOL_DEBUG
-		Serial.print("Number of datapoints: ");
-		Serial.println(datapoints);
-		#endif
+			// New firmware is rolled back at the end of this wake unless it reaches the server in it
+			uint8_t unconfirmed = 0;
+			#ifdef SOL_OTA
+			unconfirmed = SOL_otaUnconfirmed();
+			#endif
 
-		if(datapoints >= SENSE_COUNT_TO_SEND)
-		{
-			// Connect with 10 second timeout and upload 
-			if(SOL_connectToWiFi(10))
-			{	
-				#ifdef SOL_DEBUG
-				Serial.println("Connected to wifi, now uploading");
-				#endif
-				SOL_upload();
-
-				// Update time to reduce drift
-				SOL_set_time_from_ntp();
-				sleepCount = 0;
+			// Spend radio energy when it is cheapest, and never in log only or survival mode
+			charging = SOL_chargeAllowed(get_temperature_C()) && SOL_scheduleLastPower() > SOL_config()->charge_min_power_mW;
+			if(mode <= SOL_POWER_REDUCED
+				&& (unconfirmed || (SOL_scheduleShouldUpload(datapoints, minimum, capacity, batt_v, charging, SOL_getTime())
+					&& SOL_scheduleWiFiAllowed(SOL_getRawTime()))))
+			{
+				// Connect with 10 second timeout and upload 
+				SOL_enterPhase(SOL_PHASE_CONNECT);
+				if(SOL_connectToWiFi(10))
+				{	
+					SOL_scheduleWiFiConnected();
+
+					SOL_enterPhase(SOL_PHASE_UPLOAD);
+					SOL_upload();
+
+					// Update time only once drift could have pushed it past the allowed error
+					if(SOL_timeNeedsSync())
+					{
+						SOL_set_time_from_ntp();
+					}
+					sleepCount = 0;
+				}
+				else
+				{
+					// Stop retrying every wake, so an outage does not drain the battery
+					SOL_scheduleWiFiFailed(SOL_getRawTime());
+				}
 			}
 		}
 	}
 
-	// Enter deep sleep
-	SOL_deepsleep(SLEEP_TIME_SECONDS);
+	// Enter deep sleep until the next sample is due, later on low battery
+	SOL_deepsleep(SOL_powerAdjustSleep(SOL_scheduleNextSleep(SOL_getTime())));
 }
 
 /**
@@ -188,13 +401,6 @@ uint8_t SOL_hasWiFiCredentials()
 		ssid_length = SOL_readEEPROMByte(EEPROM_ADDRESS_WIFI_SSID_LENGTH);
 		pswd_length = SOL_readEEPROMByte(EEPROM_ADDRESS_WIFI_PSWD_LENGTH);
 
-		#ifdef SOL_DEBUG
-		Serial.print("SSID length: ");
-		Serial.println(ssid_length);
-		Serial.print("PSWD length: ");
-		Serial.println(pswd_length);
-		#endif
-
 		// Guard against too long
 		if(ssid_length > 64) {ssid_length = 64;}
 		if(pswd_length > 64) {pswd_length = 64;}
@@ -210,25 +416,13 @@ uint8_t SOL_hasWiFiCredentials()
 			pswd[i] = SOL_readEEPROMByte(EEPROM_ADDRESS_WIFI_PSWD_START+i);
 		}
 
-		#ifdef SOL_DEBUG
-		String str_ssid(ssid);
-		Serial.print("SSID: ");
-		Serial.println(str_ssid);
-		String str_pswd(pswd);
-		Serial.print("PSWD: ");
-		Serial.println(str_pswd);
-		#endif
-		
 	}
 	else
 	{
 		hasCred = 0;
 	}
 
-	#ifdef SOL_DEBUG
-	Serial.print("Cred: ");
-	Serial.println(hasCred);
-	#endif
+	SOL_TRACE_DEBUG(SOL_TRACE_CREDENTIALS, hasCred, ssid_length);
 
 	return hasCred;
 }
@@ -242,11 +436,7 @@ uint8_t SOL_hasWiFiCredentials()
  */
 uint8_t SOL_connectToWiFi(uint16_t timeout)
 {
-	#ifdef SOL_DEBUG
-	Serial.println("Attempting to connect to WiFi");
-	Serial.println(ssid_length);
-	Serial.println(pswd_length);
-	#endif
+	SOL_TRACE_INFO(SOL_TRACE_WIFI_CONNECTING, timeout, 0);
 
 	// Get correct parts of ssid and pswd TODO clean up?
 	char ssid_part[ssid_length+1];
@@ -260,35 +450,24 @@ uint8_t SOL_connectToWiFi(uint16_t timeout)
 
 	WiFi.begin(ssid_part,pswd_part);
 
-	#ifdef SOL_DEBUG
-	String str_ssid(ssid_part);
-	String str_pswd(pswd_part);
-	Serial.print("SSID: ");
-	Serial.println(str_ssid);
-	Serial.print("PSWD: ");
-	Serial.println(str_pswd);
-
-	Serial.println("Connecting");
-	#endif
-
 	uint8_t success = 1;
 	long start_time = millis();
 	while (WiFi.status() != WL_CONNECTED) //not connected
 	{
 		delay(50);
-		#ifdef SOL_DEBUG
-		Serial.print(".");
-		#endif
-		if((millis() - start_time) > (timeout*1000))
+		if((millis() - start_time) > (timeout*1000) || SOL_phaseExpired())
 		{
-			#ifdef SOL_DEBUG
-			Serial.println("Could not connect. Timeout");
-			#endif
+			SOL_TRACE_WARN(SOL_TRACE_WIFI_TIMEOUT, millis() - start_time, 0);
 
 			success = 0;
 			break;
 		}
 	}
+
+	if(success)
+	{
+		SOL_TRACE_INFO(SOL_TRACE_WIFI_CONNECTED, millis() - start_time, 0);
+	}
 	return success;
 }
 
@@ -305,9 +484,16 @@ void SOL_startProvisioning(void)
 	// Create SSID with ID
 	String provision_ssid = "SOL " + String(device_ID);
 
+	// Site location, used to schedule samples around sunrise and sunset
+	WiFiManagerParameter latitude_param("lat", "Latitude (deg N)", "", 12);
+	WiFiManagerParameter longitude_param("lon", "Longitude (deg E)", "", 12);
+	wifiManager.addParameter(&latitude_param);
+	wifiManager.addParameter(&longitude_param);
+
 	// Set a timeout
 	wifiManager.setTimeout(120);
-	if (wifiManager.startConfigPortal(provision_ssid.c_str())) {
+	uint8_t provisioned = wifiManager.startConfigPortal(provision_ssid.c_str());
+	if (provisioned) {
 
 		// Get the new network information and save it
 		String connected_ssid = wifiManager.getSSID();
@@ -325,9 +511,12 @@ void SOL_startProvisioning(void)
 		// Indicate wifi credentials available
 		SOL_writeEEPROMByte(EEPROM_ADDRESS_WIFI_CREDENTIALS_AVAILABLE, (uint8_t) 1);
 
-		// Reset next storage address
-		uint16_t next_storage = EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS;
-		SOL_writeEEPROMNByte(EEPROM_ADDRESS_NEXT_STORAGE_ADDRESS, (uint8_t *) &next_storage, 2);
+		if(strlen(latitude_param.getValue()) > 0 && strlen(longitude_param.getValue()) > 0)
+		{
+			SOL_setSiteLocation(atof(latitude_param.getValue()), atof(longitude_param.getValue()));
+		}
+
+		SOL_resetStorage();
 
 		SOL_set_time_from_ntp();
 	}
@@ -335,13 +524,14 @@ void SOL_startProvisioning(void)
 	// Turn off LED
 	digitalWrite(LED_PIN, LOW);
 
-	#ifdef SOL_DEBUG
-	Serial.println("Provisioned");
-	#endif
+	SOL_TRACE_INFO(SOL_TRACE_PROVISIONED, provisioned, 0);
 }
 
 /**
- * @brief Uploads all available data from EEPROM
+ * @brief Uploads data from the data log in batches, resuming from the oldest unacknowledged record
+ *
+ * 	The log tail only moves past records the server acknowledged, so an interrupted
+ * 	upload resends from where it stopped and nothing is lost
  *
  */
 void SOL_upload(void)
@@ -351,41 +541,89 @@ void SOL_upload(void)
 	digitalWrite(LED_PIN, HIGH);
 	#endif
 
-	// Check where was written last
-	uint16_t next_storage_address;
-	SOL_readEEPROMNByte(EEPROM_ADDRESS_NEXT_STORAGE_ADDRESS, (uint8_t *)&next_storage_address, 2);
-	uint16_t first_storage_address = EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS;
-
-	for(uint16_t dp = first_storage_address; dp < next_storage_address; dp += sizeof(data_packet_t))
-	{
-		// Get data from EEPROM
-		data_packet_t data = SOL_getDataPacket(dp);
-
-		// Fix ID
-		data.ID = device_ID;
-
-		#ifdef SOL_DEBUG
-		Serial.print("Address: ");
-		Serial.println(dp);
-		Serial.print("Time: ");
-		Serial.println(data.timestamp);
-		Serial.print("Power: ");
-		Serial.println(data.peak_power_mW);
-		Serial.print("Voltage: ");
-		Serial.println(data.peak_voltage_V);
-		Serial.print("Current: ");
-		Serial.println(data.peak_current_mA);
-		Serial.print("ID: ");
-		Serial.println(data.ID);
-		#endif
+	#ifndef SOL_UPLOAD_SUMMARIES_ONLY
+	// Resume from the oldest record the server has not acknowledged
+	while(SOL_storageCount() > 0)
+	{
+		// Unsent data stays in the log for the next session
+		if(SOL_phaseExpired())
+		{
+			break;
+		}
+
+		// Gather a batch starting at the tail, skipping records that can't be read back
+		data_packet_t batch[UPLOAD_BATCH_SIZE];
+		uint32_t position[UPLOAD_BATCH_SIZE];
+		uint8_t count = 0;
+		uint32_t waiting = SOL_storageCount();
+		uint32_t idx = 0;
+		for(; idx < waiting && count < UPLOAD_BATCH_SIZE; idx++)
+		{
+			if(SOL_storagePeek(idx, &batch[count]))
+			{
+				SOL_TRACE_DEBUG(SOL_TRACE_UPLOAD_RECORD, idx, batch[count].timestamp);
+				position[count] = idx;
+				count++;
+			}
+		}
+
+		if(count == 0)
+		{
+			// Nothing readable, drop what was skipped so it is not read again
+			SOL_storageDrop(idx);
+			continue;
+		}
 
-		// Upload
-		//SOL_uploadDataPacket(&data);
+		uint32_t ack;
+		if(!SOL_uploadDataPackets(batch, count, &ack) || (int32_t) (ack - batch[0].seq) < 0)
+		{
+			// Nothing accepted, keep the data for the next session
+			SOL_TRACE_WARN(SOL_TRACE_UPLOAD_ACK, batch[0].seq, 0);
+			break;
+		}
+
+		// Only move the tail past what the server acknowledged, skipped records leave gaps in the sequence
+		uint8_t accepted = 0;
+		while(accepted < count && (int32_t) (batch[accepted].seq - ack) <= 0)
+		{
+			accepted++;
+		}
+		SOL_storageDrop((accepted == count) ? idx : position[accepted - 1] + 1);
+
+		SOL_TRACE_INFO(SOL_TRACE_UPLOAD_ACK, batch[0].seq, accepted);
+
+		if(accepted < count)
+		{
+			// Partial batch, server wants no more this session
+			break;
+		}
+	}
+	#endif
+
+	#ifdef SOL_DAILY_SUMMARY
+	SOL_uploadSummaries();
+	#endif
+
+	// Report where the time goes, so regressions show up on the backend
+	SOL_uploadProfile();
+
+	#ifdef SOL_CURVE_CAPTURE
+	SOL_uploadCurve();
+	#endif
+
+	// Send the trace log along when something went wrong
+	if(SOL_traceHasWarning())
+	{
+		SOL_uploadTrace();
 	}
 
-	// Reset next storage address
-	uint16_t next_storage = EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS;
-	SOL_writeEEPROMNByte(EEPROM_ADDRESS_NEXT_STORAGE_ADDRESS, (uint8_t *) &next_storage, 2);
+	#ifdef SOL_OTA
+	// Last, a finished update restarts into the new firmware. Flash erases cost too much on a low battery
+	if(SOL_otaActive() && SOL_powerMode() == SOL_POWER_NORMAL)
+	{
+		SOL_updateFirmware();
+	}
+	#endif
 
 	#ifdef SOL_DEBUG
 	// Turn off LED
@@ -401,261 +639,933 @@ void SOL_upload(void)
  */
 void SOL_deepsleep(int len)
 {
-
-	#ifdef SOL_DEBUG
-	Serial.println("Feeling sleepy...");
+	#ifdef SOL_OTA
+	SOL_otaRollback();
 	#endif
 
+	SOL_enterPhase(SOL_PHASE_SLEEP);
+
 	// Check temperature
 	float temp_C = get_temperature_C();
 
-	#ifdef SOL_DEBUG
-	Serial.print("Temp: ");
-	Serial.print(temp_C);
-	Serial.println("C");
-	#endif
+	SOL_TRACE_INFO(SOL_TRACE_SLEEP, len, SOL_traceFloat(temp_C));
 
 	// enable charging if in OK temperature range
-	if(temp_C < CHARGE_TEMP_MAX_CELSIUS && temp_C > CHARGE_TEMP_MIN_CELSIUS)
+	if(SOL_chargeAllowed(temp_C))
 	{
 		digitalWrite(CHG_DISABLE_PIN, HIGH);
 	}
 
-	// enable timer deep sleep
-    esp_sleep_enable_timer_wakeup(len * 1000000);
-    esp_sleep_enable_touchpad_wakeup();
+	// enable timer or RTC alarm deep sleep
+	SOL_timeSleep(SOL_setWakeup(len));
+    SOL_phaseFinish();
     esp_deep_sleep_start();
 }
 
 
 /**
- * @brief Generates a new data packet from sensors
+ * @brief Reads the raw panel voltage and current ADC counts at one DAC setting
+ *
+ * @param dac The DAC value setting the load
+ * @param v_gain_idx Index into ADC_gains for the voltage reading
+ * @param i_gain_idx Index into ADC_gains for the current reading
+ * @param voltage_raw Pointer to put the voltage reading in
+ * @param current_raw Pointer to put the current reading in
  *
  */
-void SOL_generateDataPacket(void)
+void SOL_board_R2::readPointRaw(uint8_t dac, uint8_t v_gain_idx, uint8_t i_gain_idx, int16_t * voltage_raw, int16_t * current_raw)
 {
-	// Perform power sweep
-	float max_power = 0.0;
-	float max_current = 0.0;
-	float max_voltage = 0.0;
-
-	for(uint16_t gain_idx = 0; gain_idx < 3; gain_idx++)
-	{
-		ads.setGain(ADC_gains[gain_idx]);
-
-		for (uint16_t i = 0; i < DAC_RANGE; i++)
-		{
-		    // Sweep DAC
-		    dacWrite(DAC_PIN, i);
-
-		    // Read raw ADC values
-		    int16_t current_raw = ads.readADC_SingleEnded(0);
-		    int16_t voltage_raw = ads.readADC_SingleEnded(1);
-
-		    // Convert to volts
-		    float voltage = ((float) voltage_raw / (float) AD1015_RANGE) * ADC_max_v[gain_idx];
-		    voltage = voltage * V_SENSE_AMPLIFICATION;
-
-		    // Convert to amps
-		    float current = ((float) current_raw / (float) AD1015_RANGE) * ADC_max_v[gain_idx]; // Real volts measured
-		    current = current / R_SENSE ; // Ohms law I = V/R
-		    current = current / I_SENSE_AMPLIFICATION;
-
-		    float power = current * voltage;
-
-		    if (power > max_power)
-		    {
-		      max_power = power;
-		    }
-
-		    if (current > max_current)
-		    {
-		      max_current = current;
-		    }
-
-		    if (voltage > max_voltage)
-		    {
-		      max_voltage = voltage;
-		    }
-	  	}
-	  	// TODO if any ADCs are maxed out, they will should read lower than their previous max, so we can just loop
-	  	// TODO we can not loop further for efficiency if we are confident the value is reasonable
-  	}
-
-	// Get temperature
-	float temp_C = get_temperature_C();
-
-  	data_packet_t data;
-
-  	// Get battery voltage
-	data.batt_v = get_battery_voltage();
-  	data.timestamp = lastNTPTime + (sleepCount * SLEEP_TIME_SECONDS);
-  	data.peak_power_mW = max_power * 1000.0;
-  	data.peak_current_mA = max_current * 1000.0;
-  	data.peak_voltage_V = max_voltage;
-  	data.temp_celsius = temp_C;
-  	data.ID = device_ID;
-
-  	#ifdef SOL_DEBUG
-  	Serial.println("New datapoint:");
-	Serial.print("Time: ");
-	Serial.println(data.timestamp);
-	Serial.print("Power: ");
-	Serial.println(data.peak_power_mW);
-	Serial.print("Voltage: ");
-	Serial.println(data.peak_voltage_V);
-	Serial.print("Current: ");
-	Serial.println(data.peak_current_mA);
-	Serial.print("Temp, C: ");
-	Serial.println(data.temp_celsius);
-	Serial.print("Battery voltage: ");
-	Serial.println(data.batt_v);
-	Serial.print("ID: ");
-	Serial.println(data.ID);
-	#endif
-
-	// Determine where to save data
-	uint16_t next_storage_address;
-	SOL_readEEPROMNByte(EEPROM_ADDRESS_NEXT_STORAGE_ADDRESS, (uint8_t *) &next_storage_address, 2);
+	dacWrite(DAC_PIN, dac);
 
-	// Prevent attempt to write past available space, start overwriting oldest data
-	// TODO this will confuse the upload function...
-	if(next_storage_address + sizeof(data_packet_t) >= EEPROM_ADDRESS_DATA_RANGE_END_ADDRESS)
-	{
-		next_storage_address = EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS;
-	}
-
-	#ifdef SOL_DEBUG
-	Serial.print("Next datapoint address: ");
-	Serial.println(next_storage_address);
-	#endif
-
-	// Save data and location of it
-	SOL_writeEEPROMNByte(next_storage_address, (uint8_t *) &data, sizeof(data_packet_t));
-	next_storage_address += sizeof(data_packet_t);
-	SOL_writeEEPROMNByte(EEPROM_ADDRESS_NEXT_STORAGE_ADDRESS, (uint8_t *) &next_storage_address, 2);
+	ads.setGain(ADC_gains[i_gain_idx]);
+	*current_raw = ads.readADC_SingleEnded(0);
+	ads.setGain(ADC_gains[v_gain_idx]);
+	*voltage_raw = ads.readADC_SingleEnded(1);
 }
 
 /**
- * @brief Gets data packet stored in EEPROM
+ * @brief Reads the panel voltage and current at one DAC setting
  *
- * @param start_address The starting location for the data packet struct
- *
- * @return The data packet
+ * @param dac The DAC value setting the load
+ * @param v_gain_idx Index into ADC_gains for the voltage reading
+ * @param i_gain_idx Index into ADC_gains for the current reading
+ * @param voltage Pointer to put the voltage in, V
+ * @param current Pointer to put the current in, A
  *
  */
-data_packet_t SOL_getDataPacket(uint16_t start_address)
+static void SOL_readOperatingPoint(uint8_t dac, uint8_t v_gain_idx, uint8_t i_gain_idx, float * voltage, float * current)
 {
+	int16_t voltage_raw;
+	int16_t current_raw;
+	SOL_board::readPointRaw(dac, v_gain_idx, i_gain_idx, &voltage_raw, &current_raw);
 
-	data_packet_t data;
-	SOL_readEEPROMNByte(start_address, (uint8_t *) &data, sizeof(data_packet_t));
-
-	return data;
+	*voltage = voltage_raw * SOL_board::V_SCALE[v_gain_idx];
+	*current = current_raw * SOL_board::I_SCALE[i_gain_idx];
 }
 
 /**
- * @brief Uploads an individual data packet
+ * @brief Picks the highest ADC gain a reading taken at GAIN_ONE still fits in
  *
- * @param data Pointer to data packet to upload
+ * @param raw The reading at GAIN_ONE
+ * @param max_gain_idx The highest index into ADC_gains to consider
  *
+ * @return Index into ADC_gains, at most max_gain_idx
  */
-void SOL_uploadDataPacket(data_packet_t * data)
+static uint8_t SOL_pickGain(int16_t raw, uint8_t max_gain_idx)
 {
-	/*
-	*  See tutorial here: https://randomnerdtutorials.com/esp32-esp8266-publish-sensor-readings-to-google-sheets/
-	*
-	*	This function for uploading data is based heavily on that tutorial, obviously with different data
-	*/
-
-	// TODO do differently in future
-	// IFTTT URL resource
-	// NOTE: Put your own key here
-	const char* resource = "/trigger/your_key";
-
-	// Maker Webhooks IFTTT
-	const char* server = "maker.ifttt.com";
-
-	WiFiClient client;
-  	int retries = 5;
-  	while (!!!client.connect(server, 80) && (retries-- > 0)) {
-    	delay(100);
-  	}
-
-  	// Assemble data
-  	String jsonObject = String("{\"value1\":\"") + data->peak_power_mW + "\",\"value2\":\"" + data->peak_current_mA
-                      + "\",\"value3\":\"" + data->peak_voltage_V + "\"}";
-
-
-  	client.println(String("POST ") + resource + " HTTP/1.1");
-  	client.println(String("Host: ") + server);
-  	client.println("Connection: close\r\nContent-Type: application/json");
-  	client.print("Content-Length: ");
-  	client.println(jsonObject.length());
-  	client.println();
-  	client.println(jsonObject);
-
-  	int timeout = 5 * 10; // 5 seconds
-  	while (!client.available() && (timeout-- > 0)) {
-    	delay(100);
-  	}
-
-  	while (client.available()) {
-    	Serial.write(client.read());
-  	}
-  	client.stop();
+	for(uint8_t gain_idx = max_gain_idx; gain_idx > 0; gain_idx--)
+	{
+		if(raw * (1 << gain_idx) < SPARSE_GAIN_HEADROOM * AD1015_RANGE)
+		{
+			return gain_idx;
+		}
+	}
+	return 0;
 }
 
 /**
- * @brief Writes a single byte to EEPROM
+ * @brief Picks gains for a sweep from the largest readings, voltage at open circuit and current near short circuit
  *
- * @param address The address in EEPROM to write to
- * @param data The data to put into EEPROM
+ * @param v_gain_idx Pointer to put the index into ADC_gains for voltage readings in
+ * @param i_gain_idx Pointer to put the index into ADC_gains for current readings in
  *
  */
-void SOL_writeEEPROMByte(uint16_t address, uint8_t data)
+static void SOL_pickSweepGains(uint8_t * v_gain_idx, uint8_t * i_gain_idx)
 {
-	Wire.beginTransmission(EEPROM_ADDRESS);
-  	Wire.write((address >> 8)); // MSB
-  	Wire.write((address & 0xFF)); // LSB
-  	Wire.write(data);
-  	Wire.endTransmission();
-  	delay(5); // Takes 5 milliseconds to write page
+	ads.setGain(GAIN_ONE);
+	dacWrite(DAC_PIN, 0);
+	*v_gain_idx = SOL_pickGain(ads.readADC_SingleEnded(1), 2);
+	dacWrite(DAC_PIN, DAC_RANGE - 1);
+	*i_gain_idx = SOL_pickGain(ads.readADC_SingleEnded(0), 2);
 }
 
 /**
- * @brief Abstract method for writing N bytes of data to EEPROM
+ * @brief Finds peak power, current and voltage with a full sweep at each gain
  *
- * @param address The starting address in EEPROM to write to
- * @param data Pointer to the data
- * @param size The number of bytes to write
+ * @param max_power Pointer to put the peak power in, W
+ * @param max_current Pointer to put the peak current in, A
+ * @param max_voltage Pointer to put the peak voltage in, V
  *
+ * @return The confidence in the peak power, always 1
  */
-void SOL_writeEEPROMNByte(uint16_t address, uint8_t * data, uint16_t size)
+static float SOL_fullSweep(float * max_power, float * max_current, float * max_voltage)
 {
-	for(uint16_t i = 0; i < size; i++)
-	{
-		SOL_writeEEPROMByte(address+i, *(data+i));
-	}
+	SOL_sweepFull<SOL_board>(max_power, max_current, max_voltage);
+
+  	return 1.0;
 }
 
 /**
- * @brief Reads a single byte of data from EEPROM
+ * @brief Fits power as a quadratic in voltage by least squares and finds its peak
  *
- * @param address The address in EEPROM of the byte to read
- *
- * @return The byte from EEPROM
+ * @param v Voltages, V
+ * @param p Powers, W
+ * @param count Number of points, at least 3
+ * @param peak_v Pointer to put the voltage at the peak in, V
+ * @param peak_p Pointer to put the peak power in, W
  *
+ * @return R squared of the fit, 0 if the fit has no peak
  */
-uint8_t SOL_readEEPROMByte(uint16_t address)
+static float SOL_fitPowerPeak(const float * v, const float * p, uint8_t count, float * peak_v, float * peak_p)
 {
-  Wire.beginTransmission(EEPROM_ADDRESS);
-  Wire.write((address >> 8)); // MSB
-  Wire.write((address & 0xFF)); // LSB
-  Wire.endTransmission();
-  Wire.requestFrom(EEPROM_ADDRESS, 1);
-  return Wire.read();
-}
-
+	// Center voltages so the sums stay well conditioned in single precision
+	float v_mean = 0.0;
+	float p_mean = 0.0;
+	for(uint8_t i = 0; i < count; i++)
+	{
+		v_mean += v[i];
+		p_mean += p[i];
+	}
+	v_mean /= count;
+	p_mean /= count;
+
+	float s2 = 0.0, s3 = 0.0, s4 = 0.0, sp = 0.0, sxp = 0.0, sx2p = 0.0;
+	for(uint8_t i = 0; i < count; i++)
+	{
+		float x = v[i] - v_mean;
+		float x2 = x * x;
+		s2 += x2;
+		s3 += x2 * x;
+		s4 += x2 * x2;
+		sp += p[i];
+		sxp += x * p[i];
+		sx2p += x2 * p[i];
+	}
+
+	// Normal equations for p = a*x^2 + b*x + c, the sum of x is zero after centering
+	float n = count;
+	float det = s4 * (s2 * n) - s3 * (s3 * n) + s2 * (-s2 * s2);
+	if(det == 0.0)
+	{
+		return 0.0;
+	}
+	float a = (sx2p * (s2 * n) - s3 * (sxp * n) + s2 * (-s2 * sp)) / det;
+	float b = (s4 * (sxp * n) - sx2p * (s3 * n) + s2 * (s3 * sp - s2 * sxp)) / det;
+	float c = (s4 * (s2 * sp) - s3 * (s3 * sp - sxp * s2) + sx2p * (-s2 * s2)) / det;
+
+	if(a >= 0.0)
+	{
+		return 0.0;
+	}
+
+	float x_peak = -b / (2.0 * a);
+	*peak_v = x_peak + v_mean;
+	*peak_p = c - b * b / (4.0 * a);
+
+	float ss_res = 0.0;
+	float ss_tot = 0.0;
+	for(uint8_t i = 0; i < count; i++)
+	{
+		float x = v[i] - v_mean;
+		float r = p[i] - (a * x * x + b * x + c);
+		ss_res += r * r;
+		ss_tot += (p[i] - p_mean) * (p[i] - p_mean);
+	}
+
+	if(ss_tot == 0.0)
+	{
+		return 0.0;
+	}
+
+	float r2 = 1.0 - ss_res / ss_tot;
+	return (r2 > 0.0) ? r2 : 0.0;
+}
+
+/**
+ * @brief Finds peak power, current and voltage from a handful of operating points
+ *
+ * 	Takes evenly spaced points from open circuit (DAC at zero) to near short circuit, adds a
+ * 	few more around the best one, and fits power as a quadratic in voltage there. The peak of
+ * 	the fit is used when the fit is good and the peak lies between the points. Otherwise every
+ * 	DAC value around the best point is tried, like the full sweep, unless that is not allowed.
+ *
+ * @param max_power Pointer to put the peak power in, W
+ * @param max_current Pointer to put the peak current in, A
+ * @param max_voltage Pointer to put the peak voltage in, V
+ * @param allow_dense 1 to fall back to a dense search on a poor fit, 0 to use the best point measured
+ *
+ * @return The confidence in the peak power, R squared of the fit
+ */
+static float SOL_sparseSweep(float * max_power, float * max_current, float * max_voltage, uint8_t allow_dense)
+{
+	uint8_t v_gain_idx;
+	uint8_t i_gain_idx;
+	SOL_pickSweepGains(&v_gain_idx, &i_gain_idx);
+
+	uint8_t dac[SPARSE_COARSE_POINTS + SPARSE_REFINE_POINTS];
+	float v[SPARSE_COARSE_POINTS + SPARSE_REFINE_POINTS];
+	float p[SPARSE_COARSE_POINTS + SPARSE_REFINE_POINTS];
+	uint8_t count = 0;
+	uint8_t best = 0;
+
+	// Coarse points across the whole range
+	for(uint8_t j = 0; j < SPARSE_COARSE_POINTS; j++)
+	{
+		float current;
+		dac[count] = (uint8_t) ((j * (DAC_RANGE - 1) + (SPARSE_COARSE_POINTS - 1) / 2) / (SPARSE_COARSE_POINTS - 1));
+		SOL_readOperatingPoint(dac[count], v_gain_idx, i_gain_idx, &v[count], &current);
+		p[count] = v[count] * current;
+
+		if(current > *max_current) {*max_current = current;}
+		if(v[count] > *max_voltage) {*max_voltage = v[count];}
+		if(p[count] > p[best]) {best = count;}
+		count++;
+	}
+
+	// Bracket around the best coarse point
+	uint8_t low = (best > 0) ? dac[best - 1] : dac[best];
+	uint8_t high = (best < SPARSE_COARSE_POINTS - 1) ? dac[best + 1] : dac[best];
+
+	// Refine points spread evenly through the bracket, skipping the coarse ones
+	for(uint8_t j = 1; j <= SPARSE_REFINE_POINTS + 1; j++)
+	{
+		uint8_t d = low + (uint16_t) j * (high - low) / (SPARSE_REFINE_POINTS + 2);
+		if(d == low || d == high || d == dac[best] || count == SPARSE_COARSE_POINTS + SPARSE_REFINE_POINTS)
+		{
+			continue;
+		}
+
+		float current;
+		dac[count] = d;
+		SOL_readOperatingPoint(d, v_gain_idx, i_gain_idx, &v[count], &current);
+		p[count] = v[count] * current;
+		if(p[count] > p[best]) {best = count;}
+		count++;
+	}
+
+	// Fit only inside the bracket, the quadratic can't follow the whole curve
+	float fit_v[SPARSE_COARSE_POINTS + SPARSE_REFINE_POINTS];
+	float fit_p[SPARSE_COARSE_POINTS + SPARSE_REFINE_POINTS];
+	uint8_t fit_count = 0;
+	float fit_v_min = v[best];
+	float fit_v_max = v[best];
+	for(uint8_t j = 0; j < count; j++)
+	{
+		if(dac[j] >= low && dac[j] <= high)
+		{
+			fit_v[fit_count] = v[j];
+			fit_p[fit_count] = p[j];
+			fit_count++;
+			if(v[j] < fit_v_min) {fit_v_min = v[j];}
+			if(v[j] > fit_v_max) {fit_v_max = v[j];}
+		}
+	}
+
+	float peak_v = 0.0;
+	float peak_p = 0.0;
+	float confidence = 0.0;
+	if(fit_count >= 3)
+	{
+		confidence = SOL_fitPowerPeak(fit_v, fit_p, fit_count, &peak_v, &peak_p);
+	}
+
+	// A trustworthy peak lies between the points and can't be below a measured point
+	uint8_t fit_ok = (confidence >= SPARSE_MIN_CONFIDENCE) && (peak_v >= fit_v_min) && (peak_v <= fit_v_max)
+		&& (peak_p >= p[best]) && (peak_p <= p[best] * SPARSE_MAX_PEAK_RATIO);
+
+	if(fit_ok)
+	{
+		*max_power = peak_p;
+	}
+	else if(!allow_dense)
+	{
+		*max_power = p[best];
+	}
+	else
+	{
+		// Dense local search through the bracket
+		*max_power = p[best];
+		SOL_sweep_max_t max;
+		SOL_sweepMaxReset(&max);
+		for(uint16_t d = low; d <= high; d++)
+		{
+			int16_t voltage_raw;
+			int16_t current_raw;
+			SOL_board::readPointRaw(d, v_gain_idx, i_gain_idx, &voltage_raw, &current_raw);
+			SOL_sweepMaxAdd(&max, voltage_raw, current_raw);
+		}
+		SOL_sweepMaxToUnits(&max, SOL_board::V_SCALE[v_gain_idx], SOL_board::I_SCALE[i_gain_idx], max_power, max_current, max_voltage);
+	}
+
+	SOL_TRACE_INFO(SOL_TRACE_MPP_FIT, SOL_traceFloat(confidence), !fit_ok);
+
+	return confidence;
+}
+
+/**
+ * @brief Delta encodes a series of readings into signed bytes, scaled down by a shift
+ *
+ * 	Each delta is taken from the previously decoded value, so rounding never accumulates.
+ *
+ * @param raw The readings, CURVE_POINTS of them
+ * @param stride Distance between readings in raw, to encode one channel of interleaved data
+ * @param shift The right shift applied to each delta
+ * @param deltas Where to put the deltas, CURVE_POINTS - 1 of them spaced by stride
+ *
+ * @return 1 if every delta fit, otherwise 0 and the deltas that did not fit are clamped
+ */
+static uint8_t SOL_curveEncode(const int16_t * raw, uint8_t stride, uint8_t shift, int8_t * deltas)
+{
+	uint8_t fit = 1;
+	int16_t decoded = raw[0];
+	int16_t half = (1 << shift) >> 1;
+	for(uint8_t k = 1; k < CURVE_POINTS; k++)
+	{
+		int16_t d = raw[k * stride] - decoded;
+		int16_t q = (d >= 0) ? ((d + half) >> shift) : -((-d + half) >> shift);
+		if(q > 127 || q < -128)
+		{
+			q = (q > 0) ? 127 : -128;
+			fit = 0;
+		}
+		deltas[(k - 1) * stride] = (int8_t) q;
+		decoded += q * (1 << shift);
+	}
+	return fit;
+}
+
+/**
+ * @brief Captures a decimated, delta compressed I-V curve once every CURVE_CAPTURE_INTERVAL_SECONDS
+ *
+ * 	Only the latest curve is kept. It waits in EEPROM until uploaded by SOL_uploadCurve.
+ *
+ * @param timestamp The timestamp of the data packet taken with the curve
+ * @param seq The sequence number of the data packet taken with the curve
+ *
+ */
+static void SOL_captureCurve(uint32_t timestamp, uint32_t seq)
+{
+	if(curveCaptured && (SOL_getRawTime() - curveRawTime) < CURVE_CAPTURE_INTERVAL_SECONDS)
+	{
+		return;
+	}
+
+	static_assert(sizeof(iv_curve_t) <= 0x1000 - EEPROM_ADDRESS_CURVE_START, "I-V curve does not fit in EEPROM");
+
+	SOL_enterPhase(SOL_PHASE_SWEEP);
+
+	iv_curve_t curve;
+	curve.timestamp = timestamp;
+	curve.seq = seq;
+	curve.uploaded = 0;
+	SOL_pickSweepGains(&curve.v_gain_idx, &curve.i_gain_idx);
+
+	// Voltage and current interleaved, like the deltas
+	int16_t raw[2 * CURVE_POINTS];
+	for(uint8_t k = 0; k < CURVE_POINTS; k++)
+	{
+		uint8_t dac = (uint8_t) ((uint16_t) k * (DAC_RANGE - 1) / (CURVE_POINTS - 1));
+		SOL_board::readPointRaw(dac, curve.v_gain_idx, curve.i_gain_idx, &raw[2 * k], &raw[2 * k + 1]);
+	}
+	curve.v0 = raw[0];
+	curve.i0 = raw[1];
+
+	// Smallest shift that fits both channels, single ended readings are 0 - 2047 so a shift of 5 always fits
+	for(curve.shift = 0; curve.shift <= 5; curve.shift++)
+	{
+		uint8_t v_fit = SOL_curveEncode(&raw[0], 2, curve.shift, &curve.deltas[0]);
+		uint8_t i_fit = SOL_curveEncode(&raw[1], 2, curve.shift, &curve.deltas[1]);
+		if((v_fit && i_fit) || curve.shift == 5)
+		{
+			break;
+		}
+	}
+
+	SOL_enterPhase(SOL_PHASE_STORAGE);
+	SOL_writeEEPROMNByte(EEPROM_ADDRESS_CURVE_START, (uint8_t *) &curve, sizeof(iv_curve_t));
+
+	curveCaptured = 1;
+	curveRawTime = SOL_getRawTime();
+
+	SOL_TRACE_INFO(SOL_TRACE_CURVE, CURVE_POINTS, curve.shift);
+}
+
+/**
+ * @brief Generates a new data packet from sensors
+ *
+ */
+void SOL_generateDataPacket(void)
+{
+	SOL_enterPhase(SOL_PHASE_SWEEP);
+
+	// Perform power sweep
+	float max_power = 0.0;
+	float max_current = 0.0;
+	float max_voltage = 0.0;
+
+	// On low battery, settle for the sparse points alone
+	uint8_t reduced = SOL_powerMode() != SOL_POWER_NORMAL;
+
+	#ifdef SOL_SPARSE_SWEEP
+	float confidence = SOL_sparseSweep(&max_power, &max_current, &max_voltage, !reduced);
+	#else
+	float confidence = reduced ? SOL_sparseSweep(&max_power, &max_current, &max_voltage, 0)
+		: SOL_fullSweep(&max_power, &max_current, &max_voltage);
+	#endif
+
+	// A slow sweep means a struggling ADC or bus, so skip optional extra sweeps this wake
+	uint8_t sweep_overrun = SOL_phaseExpired() || reduced;
+
+	// Get temperature
+	float temp_C = get_temperature_C();
+
+  	data_packet_t data;
+
+  	// Get battery voltage
+	data.batt_v = get_battery_voltage();
+  	// Before time is first set, timestamps count from the first wake
+  	data.timestamp = SOL_getTime();
+  	if(data.timestamp == 0)
+  	{
+  		data.timestamp = SOL_getRawTime();
+  	}
+  	data.peak_power_mW = max_power * 1000.0;
+  	data.peak_current_mA = max_current * 1000.0;
+  	data.peak_voltage_V = max_voltage;
+  	data.temp_celsius = temp_C;
+  	data.ID = device_ID;
+  	data.confidence = confidence;
+
+  	#ifdef SOL_REF_CELLS
+  	// Measured in this wake, so the sweep's fixed costs cover them too
+  	for(uint8_t cell = 0; cell < REF_CELL_COUNT; cell++)
+  	{
+  		data.ref_W_m2[cell] = get_reference_irradiance(cell);
+  		SOL_TRACE_INFO(SOL_TRACE_REF_CELL, cell, SOL_traceFloat(data.ref_W_m2[cell]));
+  	}
+  	#endif
+
+  	SOL_scheduleRecordSample(data.peak_power_mW);
+
+  	#ifdef SOL_DAILY_SUMMARY
+  	SOL_summaryAddSample(SOL_getTime(), data.peak_power_mW);
+  	#endif
+
+	// Save data
+	SOL_enterPhase(SOL_PHASE_STORAGE);
+	SOL_readEEPROMNByte(EEPROM_ADDRESS_NEXT_SEQUENCE, (uint8_t *) &data.seq, 4);
+
+	SOL_TRACE_INFO(SOL_TRACE_SAMPLE, data.timestamp, data.seq);
+	SOL_TRACE_INFO(SOL_TRACE_SAMPLE_POWER, SOL_traceFloat(data.peak_power_mW), SOL_traceFloat(data.peak_current_mA));
+	SOL_TRACE_INFO(SOL_TRACE_SAMPLE_VOLTAGE, SOL_traceFloat(data.peak_voltage_V), SOL_traceFloat(data.batt_v));
+	SOL_TRACE_INFO(SOL_TRACE_SAMPLE_TEMP, SOL_traceFloat(data.temp_celsius), 0);
+
+	SOL_storageAppend(&data);
+
+	uint32_t next_seq = data.seq + 1;
+	SOL_writeEEPROMNByte(EEPROM_ADDRESS_NEXT_SEQUENCE, (uint8_t *) &next_seq, 4);
+
+	#ifdef SOL_CURVE_CAPTURE
+	if(!sweep_overrun)
+	{
+		SOL_captureCurve(data.timestamp, data.seq);
+	}
+	#endif
+}
+
+/**
+ * @brief Sends a JSON object to the upload server and waits for the response to start
+ *
+ * @param client The client to send with, left connected to read the response
+ * @param resource The resource on the server to post to
+ * @param json The JSON object
+ *
+ * @return 1 if the server started responding, otherwise 0
+ *
+ */
+static uint8_t SOL_httpRequest(WiFiClient & client, const char * resource, const String & json)
+{
+	/*
+	*  See tutorial here: https://randomnerdtutorials.com/esp32-esp8266-publish-sensor-readings-to-google-sheets/
+	*
+	*	This function for uploading data is based heavily on that tutorial, obviously with different data
+	*/
+
+	// Whatever is not sent in time is retried on a later wake
+	if(SOL_phaseExpired())
+	{
+		return 0;
+	}
+
+  	int retries = 5;
+  	while (!!!client.connect(SOL_UPLOAD_SERVER, SOL_UPLOAD_PORT) && (retries-- > 0) && !SOL_phaseExpired()) {
+    	delay(100);
+  	}
+  	if(!client.connected()) {
+  		return 0;
+  	}
+
+  	client.println(String("POST ") + resource + " HTTP/1.1");
+  	client.println(String("Host: ") + SOL_UPLOAD_SERVER);
+  	client.println("Connection: close\r\nContent-Type: application/json");
+  	client.print("Content-Length: ");
+  	client.println(json.length());
+  	client.println();
+  	client.println(json);
+
+  	int timeout = 5 * 10; // 5 seconds
+  	while (!client.available() && (timeout-- > 0) && !SOL_phaseExpired()) {
+    	delay(100);
+  	}
+
+  	return client.available() ? 1 : 0;
+}
+
+/**
+ * @brief Posts a JSON object to the upload server
+ *
+ * @param resource The resource on the server to post to
+ * @param json The JSON object
+ * @param response Pointer to String to put the server response in, or NULL
+ *
+ * @return 1 if the server responded, otherwise 0
+ *
+ */
+static uint8_t SOL_httpPost(const char * resource, const String & json, String * response)
+{
+	WiFiClient client;
+  	uint8_t responded = SOL_httpRequest(client, resource, json);
+
+  	uint16_t response_length = 0;
+  	while (client.available()) {
+  		char c = client.read();
+  		if(response != NULL)
+  		{
+  			*response += c;
+  		}
+  		response_length++;
+  	}
+  	client.stop();
+
+  	SOL_TRACE_INFO(SOL_TRACE_HTTP_RESPONSE, responded, response_length);
+
+  	#ifdef SOL_OTA
+  	// New firmware that can reach the server can also be sent a fix, so keep it
+  	if(responded)
+  	{
+  		SOL_otaConfirm();
+  	}
+  	#endif
+
+  	return responded;
+}
+
+/**
+ * @brief Posts a JSON object to the upload server and reads a binary response body
+ *
+ * @param resource The resource on the server to post to
+ * @param json The JSON object
+ * @param body Pointer to put the response body in
+ * @param capacity The most bytes the body may hold
+ * @param length Pointer to put the number of body bytes in
+ *
+ * @return 1 if the server sent the whole body with status 200, otherwise 0
+ *
+ */
+static uint8_t SOL_httpPostBinary(const char * resource, const String & json, uint8_t * body, uint32_t capacity, uint32_t * length)
+{
+	WiFiClient client;
+	*length = 0;
+	if(!SOL_httpRequest(client, resource, json))
+	{
+		client.stop();
+		SOL_TRACE_INFO(SOL_TRACE_HTTP_RESPONSE, 0, 0);
+		return 0;
+	}
+
+	// Status line, then headers up to a blank line
+	String line = client.readStringUntil('\n');
+	uint8_t status_ok = line.indexOf(" 200") > 0;
+	uint32_t content_length = 0;
+	while(client.connected() || client.available())
+	{
+		line = client.readStringUntil('\n');
+		if(line.length() <= 1)
+		{
+			break;
+		}
+		line.toLowerCase();
+		if(line.startsWith("content-length:"))
+		{
+			content_length = line.substring(15).toInt();
+		}
+	}
+
+	if(!status_ok || content_length > capacity)
+	{
+		client.stop();
+		SOL_TRACE_INFO(SOL_TRACE_HTTP_RESPONSE, 0, content_length);
+		return 0;
+	}
+
+	int timeout = 5 * 10; // 5 seconds without progress
+	while(*length < content_length && timeout > 0 && !SOL_phaseExpired())
+	{
+		int n = client.read(body + *length, content_length - *length);
+		if(n > 0)
+		{
+			*length += n;
+		}
+		else
+		{
+			delay(100);
+			timeout--;
+		}
+	}
+	client.stop();
+
+	SOL_TRACE_INFO(SOL_TRACE_HTTP_RESPONSE, 1, *length);
+
+	return *length == content_length;
+}
+
+/**
+ * @brief Finds the acknowledgement in a server response
+ *
+ * @param response The response, containing {"ack":N}
+ * @param ack Pointer to put N in
+ *
+ * @return 1 if the response held an acknowledgement, otherwise 0
+ *
+ */
+static uint8_t SOL_parseAck(const String & response, uint32_t * ack)
+{
+	int ack_idx = response.indexOf("\"ack\":");
+	if(ack_idx < 0)
+	{
+		return 0;
+	}
+
+	*ack = (uint32_t) strtoul(response.c_str() + ack_idx + 6, NULL, 10);
+	return 1;
+}
+
+/**
+ * @brief Uploads a batch of data packets and gets the server acknowledgement
+ *
+ * 	Records are sent with their sequence numbers. The server responds with
+ * 	{"ack":N}, the highest sequence number it has stored, and possibly new settings for SOL_config.h.
+ *
+ * @param data Pointer to the data packets to upload
+ * @param count The number of data packets
+ * @param ack Pointer to put the acknowledged sequence number in
+ *
+ * @return 1 if the server acknowledged, otherwise 0
+ *
+ */
+uint8_t SOL_uploadDataPackets(data_packet_t * data, uint8_t count, uint32_t * ack)
+{
+  	// Assemble data
+  	String jsonObject = String("{\"ID\":") + device_ID + ",\"cfg\":" + SOL_config()->version + ",\"fw\":" + SOL_FIRMWARE_VERSION + ",\"records\":[";
+  	for(uint8_t i = 0; i < count; i++)
+  	{
+  		if(i > 0) {jsonObject += ",";}
+  		jsonObject += String("{\"seq\":") + data[i].seq + ",\"time\":" + data[i].timestamp
+  			+ ",\"power\":" + data[i].peak_power_mW + ",\"current\":" + data[i].peak_current_mA
+  			+ ",\"voltage\":" + data[i].peak_voltage_V + ",\"temp\":" + data[i].temp_celsius
+  			+ ",\"batt\":" + data[i].batt_v + ",\"conf\":" + data[i].confidence;
+  		#ifdef SOL_REF_CELLS
+  		jsonObject += ",\"ref\":[";
+  		for(uint8_t cell = 0; cell < REF_CELL_COUNT; cell++)
+  		{
+  			if(cell > 0) {jsonObject += ",";}
+  			jsonObject += data[i].ref_W_m2[cell];
+  		}
+  		jsonObject += "]";
+  		#endif
+  		jsonObject += "}";
+  	}
+  	jsonObject += "]}";
+
+  	String response;
+  	if(!SOL_httpPost(SOL_UPLOAD_RESOURCE, jsonObject, &response))
+  	{
+  		return 0;
+  	}
+
+  	SOL_configUpdate(response);
+  	#ifdef SOL_OTA
+  	SOL_otaOffer(response);
+  	#endif
+  	return SOL_parseAck(response, ack);
+}
+
+/**
+ * @brief Uploads the wake cycle phase profile, starting a new profiling interval once received
+ *
+ */
+void SOL_uploadProfile(void)
+{
+	String jsonObject = String("{\"ID\":") + device_ID + ",\"phases\":" + SOL_profileToJSON() + "}";
+
+	if(SOL_httpPost(SOL_PROFILE_RESOURCE, jsonObject, NULL))
+	{
+		SOL_profileReset();
+	}
+}
+
+/**
+ * @brief Uploads the stored I-V curve if it has not been uploaded yet
+ *
+ * 	The curve is sent as stored, with scales to turn ADC counts into volts and amps.
+ * 	Point k is v0 + (sum of the first k voltage deltas << shift), likewise for current.
+ *
+ */
+void SOL_uploadCurve(void)
+{
+	iv_curve_t curve;
+	SOL_readEEPROMNByte(EEPROM_ADDRESS_CURVE_START, (uint8_t *) &curve, sizeof(iv_curve_t));
+
+	if(curve.uploaded != 0 || curve.v_gain_idx > 2 || curve.i_gain_idx > 2)
+	{
+		return;
+	}
+
+	static const char hex_digits[] = "0123456789ABCDEF";
+	String deltas;
+	deltas.reserve(sizeof(curve.deltas) * 2);
+	for(uint8_t k = 0; k < sizeof(curve.deltas); k++)
+	{
+		uint8_t b = (uint8_t) curve.deltas[k];
+		deltas += hex_digits[b >> 4];
+		deltas += hex_digits[b & 0xF];
+	}
+
+	float v_scale = SOL_board::V_SCALE[curve.v_gain_idx];
+	float i_scale = SOL_board::I_SCALE[curve.i_gain_idx];
+
+	String jsonObject = String("{\"ID\":") + device_ID + ",\"seq\":" + curve.seq + ",\"time\":" + curve.timestamp
+		+ ",\"points\":" + CURVE_POINTS + ",\"shift\":" + curve.shift
+		+ ",\"vscale\":" + String(v_scale, 8) + ",\"iscale\":" + String(i_scale, 8)
+		+ ",\"v0\":" + curve.v0 + ",\"i0\":" + curve.i0 + ",\"deltas\":\"" + deltas + "\"}";
+
+	if(SOL_httpPost(SOL_CURVE_RESOURCE, jsonObject, NULL))
+	{
+		curve.uploaded = 1;
+		SOL_writeEEPROMNByte(EEPROM_ADDRESS_CURVE_START + offsetof(iv_curve_t, uploaded), &curve.uploaded, 1);
+	}
+}
+
+/**
+ * @brief Uploads the finished daily summaries, dropping those the server acknowledges
+ *
+ * 	The server responds with {"ack":N}, the last day it has stored.
+ *
+ */
+void SOL_uploadSummaries(void)
+{
+	uint8_t count = SOL_summaryPendingCount();
+	if(count == 0)
+	{
+		return;
+	}
+
+	String jsonObject = String("{\"ID\":") + device_ID + ",\"cfg\":" + SOL_config()->version + ",\"fw\":" + SOL_FIRMWARE_VERSION + ",\"summaries\":[";
+	for(uint8_t i = 0; i < count; i++)
+	{
+		daily_summary_t summary = SOL_summaryGetPending(i);
+
+		if(i > 0) {jsonObject += ",";}
+		jsonObject += String("{\"day\":") + summary.day + ",\"energy\":" + summary.energy_mWh
+			+ ",\"min\":" + summary.min_power_mW + ",\"max\":" + summary.max_power_mW
+			+ ",\"samples\":" + summary.samples + ",\"above\":" + summary.minutes_above + ",\"hist\":[";
+		for(uint8_t bin = 0; bin < SUMMARY_HISTOGRAM_BINS; bin++)
+		{
+			if(bin > 0) {jsonObject += ",";}
+			jsonObject += summary.histogram_minutes[bin];
+		}
+		jsonObject += "]}";
+	}
+	jsonObject += "]}";
+
+	String response;
+	uint32_t ack;
+	if(!SOL_httpPost(SOL_SUMMARY_RESOURCE, jsonObject, &response))
+	{
+		return;
+	}
+
+	SOL_configUpdate(response);
+	#ifdef SOL_OTA
+	SOL_otaOffer(response);
+	#endif
+	if(SOL_parseAck(response, &ack))
+	{
+		SOL_summaryAcknowledge(ack);
+	}
+}
+
+/**
+ * @brief Uploads the binary trace log, decode with tools/sol_trace_decode.py
+ *
+ */
+void SOL_uploadTrace(void)
+{
+	String jsonObject = String("{\"ID\":") + device_ID + ",\"trace\":\"" + SOL_traceToHex() + "\"}";
+
+	if(SOL_httpPost(SOL_TRACE_RESOURCE, jsonObject, NULL))
+	{
+		SOL_traceUploaded();
+	}
+}
+
+/**
+ * @brief Downloads and applies the next chunks of an offered firmware update
+ *
+ * 	Stops after OTA_CHUNKS_PER_SESSION requests or at the phase deadline, the rest is
+ * 	fetched in later sessions. Restarts into the new firmware once it is verified.
+ *
+ */
+void SOL_updateFirmware(void)
+{
+	static uint8_t chunk[OTA_CHUNK_SIZE];
+
+	SOL_enterPhase(SOL_PHASE_OTA);
+
+	uint8_t requests = 0;
+	while(SOL_otaActive() && !SOL_otaComplete() && !SOL_phaseExpired())
+	{
+		// Once the whole delta is here, only a long copy from the running image can be left
+		uint32_t length = 0;
+		if(SOL_otaRemaining() > 0)
+		{
+			if(requests++ >= OTA_CHUNKS_PER_SESSION)
+			{
+				break;
+			}
+
+			uint32_t wanted = (SOL_otaRemaining() > OTA_CHUNK_SIZE) ? OTA_CHUNK_SIZE : SOL_otaRemaining();
+			String jsonObject = String("{\"ID\":") + device_ID + ",\"version\":" + SOL_otaVersion()
+				+ ",\"offset\":" + SOL_otaOffset() + ",\"length\":" + wanted + "}";
+			if(!SOL_httpPostBinary(SOL_OTA_RESOURCE, jsonObject, chunk, wanted, &length) || length == 0)
+			{
+				// Asked again from the same offset next session
+				break;
+			}
+		}
+
+		if(!SOL_otaWrite(chunk, length))
+		{
+			break;
+		}
+	}
+
+	SOL_TRACE_INFO(SOL_TRACE_OTA_PROGRESS, SOL_otaOffset(), SOL_otaRemaining());
+
+	if(SOL_otaComplete() && !SOL_phaseExpired() && SOL_otaFinish())
+	{
+		ESP.restart();
+	}
+}
+
+/**
+ * @brief Writes a single byte to EEPROM
+ *
+ * @param address The address in EEPROM to write to
+ * @param data The data to put into EEPROM
+ *
+ */
+void SOL_writeEEPROMByte(uint16_t address, uint8_t data)
+{
+	Wire.beginTransmission(EEPROM_ADDRESS);
+  	Wire.write((address >> 8)); // MSB
+  	Wire.write((address & 0xFF)); // LSB
+  	Wire.write(data);
+  	Wire.endTransmission();
+  	delay(5); // Takes 5 milliseconds to write page
+}
+
+/**
+ * @brief Abstract method for writing N bytes of data to EEPROM
+ *
+ * @param address The starting address in EEPROM to write to
+ * @param data Pointer to the data
+ * @param size The number of bytes to write
+ *
+ */
+void SOL_writeEEPROMNByte(uint16_t address, uint8_t * data, uint16_t size)
+{
+	SOL_eepromWrite<SOL_board>(address, data, size);
+}
+
+/**
+ * @brief Reads a single byte of data from EEPROM
+ *
+ * @param address The address in EEPROM of the byte to read
+ *
+ * @return The byte from EEPROM
+ *
+ */
+uint8_t SOL_readEEPROMByte(uint16_t address)
+{
+  Wire.beginTransmission(EEPROM_ADDRESS);
+  Wire.write((address >> 8)); // MSB
+  Wire.write((address & 0xFF)); // LSB
+  Wire.endTransmission();
+  Wire.requestFrom(EEPROM_ADDRESS, 1);
+  return Wire.read();
+}
+
 
 /**
  * @brief Abstract method for reading N bytes of data from EEPROM
@@ -667,12 +1577,7 @@ uint8_t SOL_readEEPROMByte(uint16_t address)
  */
 void SOL_readEEPROMNByte(uint16_t address, uint8_t * data, uint16_t size)
 {
-	// TODO make faster version by request consecutive data
-
-	for(uint16_t i = 0; i < size; i++)
-	{
-		data[i] = SOL_readEEPROMByte(address+i);
-	}
+	SOL_eepromRead<SOL_board>(address, data, size);
 }
 
 /**
@@ -688,6 +1593,19 @@ float get_temperature_C(void)
 	return (v_meas - TEMP_SENSE_OFFSET_C) / TEMP_SENSE_COEFF;
 }
 
+/**
+ * @brief Checks if the battery may be charged at a temperature
+ *
+ * @param temp_C The temperature in celsius
+ *
+ * @return 1 if charging is allowed, otherwise 0
+ *
+ */
+uint8_t SOL_chargeAllowed(float temp_C)
+{
+	return (temp_C < SOL_config()->charge_temp_max_C && temp_C > SOL_config()->charge_temp_min_C);
+}
+
 /**
  * @brief Reads the battery voltage
  *
@@ -705,31 +1623,62 @@ float get_battery_voltage(void)
 	return v_meas * 2.0;
 }
 
+/**
+ * @brief Reads the irradiance at a reference cell, selecting it on the mux first
+ *
+ * @param cell The reference cell, less than REF_CELL_COUNT
+ *
+ * @return The irradiance in W/m2
+ *
+ */
+float get_reference_irradiance(uint8_t cell)
+{
+	#ifdef SOL_REF_CELLS
+	if(REF_CELL_MUX_BITS > 0)
+	{
+		for(uint8_t bit = 0; bit < REF_CELL_MUX_BITS; bit++)
+		{
+			pinMode(ref_cell_mux_pins[bit], OUTPUT);
+			digitalWrite(ref_cell_mux_pins[bit], (cell >> bit) & 1);
+		}
+		delay(REF_CELL_MUX_SETTLE_MS);
+	}
+
+	// Cells give small shunt voltages, so read again at the highest gain that fits, up to GAIN_SIXTEEN
+	ads.setGain(GAIN_ONE);
+	uint8_t gain_idx = SOL_pickGain(ads.readADC_SingleEnded(REF_CELL_CHANNEL), sizeof(ADC_gains) / sizeof(ADC_gains[0]) - 1);
+	ads.setGain(ADC_gains[gain_idx]);
+	float v_cell = ads.readADC_SingleEnded(REF_CELL_CHANNEL) * SOL_voltsPerCount(4.096 / (1 << gain_idx), AD1015_RANGE, 1.0);
+
+	return v_cell * ref_cell_w_m2_per_v[cell];
+	#else
+	return 0.0;
+	#endif
+}
+
 /**
  * @brief Sets time from network time protocol server
  */
  void SOL_set_time_from_ntp(void)
  {
+ 	SOL_enterPhase(SOL_PHASE_NTP);
+
  	if(SOL_hasWiFiCredentials() && SOL_connectToWiFi(10))
  	{
  		configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
  		struct tm timeinfo;
-		if(getLocalTime(&timeinfo))
+		if(getLocalTime(&timeinfo, SOL_phaseRemainingMs()))
 		{
-			#ifdef SOL_DEBUG
-		    Serial.println(&timeinfo, "%A, %B %d %Y %H:%M:%S");
-		    #endif
-
-		    /*lastNTPTime = timeinfo.tm_sec;
-		    lastNTPTime += timeinfo.tm_min * 60;
-			lastNTPTime += timeinfo.tm_hour * 3600;
-			lastNTPTime += timeinfo.tm_mday * 86400;
-			lastNTPTime += timeinfo.tm_mon * 2592000;
-			lastNTPTime += (timeinfo.tm_year - 1970) * 31104000;*/
-
 			time_t now;
 			time(&now);
-			lastNTPTime = (uint32_t) now;
+
+			SOL_TRACE_INFO(SOL_TRACE_NTP_TIME, (uint32_t) now, 0);
+
+			SOL_timeCorrect((uint32_t) now, SOL_TIME_SOURCE_NTP);
+
+			// Keep the MCP7940 on wall clock time, so it can raise wakeup alarms and correct drift
+			setRTCEpoch((uint32_t) now);
+			rtcTimeSet = 1;
 
   		}
  	}
@@ -33,7 +33,9 @@ SOFTWARE.
 #ifndef SOL_V2_h
 #define SOL_V2_h
 
-#define SOL_DEBUG
+#include <SOL_sweep.h>
+
+//#define SOL_DEBUG													// Starts Serial on every wake, use the trace log instead
 
 //Define I2C addresses
 #define EEPROM_ADDRESS 									0x50				// I2C EEPROM address
@@ -47,6 +49,7 @@ SOFTWARE.
 #define DAC_PIN              							25
 #define TEMP_SENSE_PIN									A7
 #define TOUCH_PIN										T0 //T1 is pin0, T0 is pin 4
+#define RTC_MFP_PIN										33					// MCP7940 alarm output, must be an RTC GPIO. NOTE: not connected on R2, see SOL_RTC_ALARM_WAKE
 #define DAC_RANGE            							255
 #define ADC_RANGE            							4095
 #define AD1015_RANGE            						2048
@@ -64,19 +67,182 @@ SOFTWARE.
 #define EEPROM_ADDRESS_WIFI_PSWD_END					0x006A				// Location of end of WiFi password
 #define EEPROM_ADDRESS_WIFI_SSID_LENGTH					0x006B				// Location of length of WiFi SSID length (# of chars)
 #define EEPROM_ADDRESS_WIFI_PSWD_LENGTH					0x006C				// Location of length of WiFi PSWD length (# of chars)
-#define EEPROM_ADDRESS_NEXT_STORAGE_ADDRESS				0x006D				// Location of information about where data was stored last (also takes 0x006E)
+#define EEPROM_ADDRESS_NEXT_STORAGE_ADDRESS				0x006D				// Location of address where next data will be stored, the log head (also takes 0x006E)
 #define EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS 		0x006F				// Location of start of data address
-#define EEPROM_ADDRESS_DATA_RANGE_END_ADDRESS 			0x0FA0				// Last location available in 32kbit EEPROM
-
+#define EEPROM_ADDRESS_DATA_RANGE_END_ADDRESS 			0x0F80				// End of data, one past the last usable location
+#define EEPROM_ADDRESS_CONFIG_START						0x0F80				// Location of duty cycle settings, SOL_config_t (one EEPROM page)
+#define EEPROM_ADDRESS_CONFIG_END						0x0F9F
+#define EEPROM_ADDRESS_SITE_AVAILABLE					0x0FA0				// Location for flag if site location has been set
+#define EEPROM_ADDRESS_SITE_LATITUDE					0x0FA1				// Location of site latitude, float (also takes 0x0FA2 - 0x0FA4)
+#define EEPROM_ADDRESS_SITE_LONGITUDE					0x0FA5				// Location of site longitude, float (also takes 0x0FA6 - 0x0FA8)
+#define EEPROM_ADDRESS_TAIL_STORAGE_ADDRESS				0x0FA9				// Location of address of oldest data not acknowledged by server, the log tail (also takes 0x0FAA)
+#define EEPROM_ADDRESS_NEXT_SEQUENCE					0x0FAB				// Location of sequence number for next data (also takes 0x0FAC - 0x0FAE)
+#define EEPROM_ADDRESS_RECORD_SIZE						0x0FAF				// Location of sizeof(data_packet_t) the data log was written with
+#define EEPROM_ADDRESS_CURVE_START						0x0FB0				// Location of the latest I-V curve, iv_curve_t (up to 0x0FFF)
+
+// Sleep times, upload counts and the charge and upload thresholds below are defaults, the server can change them
 #define SLEEP_TIME_SECONDS								30 //600			// Amount of time to sleep between sensing
-#define SENSE_COUNT_TO_SEND								4					// Number of sensing datapoints before upload
+#define SENSE_COUNT_TO_SEND								4					// Minimum number of sensing datapoints before upload
+#define NIGHT_SLEEP_TIME_SECONDS						1800				// Amount of time to sleep when the panel is dark
+#define NIGHT_VOC_THRESHOLD_V							1.0					// Open circuit voltage below which the panel is considered dark
+
+// Solar schedule, used once site location and time are known
+#define SCHEDULE_NOON_SLEEP_SECONDS						SLEEP_TIME_SECONDS			// Sleep time around solar noon
+#define SCHEDULE_EDGE_SLEEP_SECONDS						(4*SLEEP_TIME_SECONDS)		// Sleep time near sunrise and sunset
+#define SCHEDULE_SUNRISE_MARGIN_SECONDS					600					// Wake this long before sunrise
+#define SCHEDULE_MAX_SLEEP_SECONDS						43200				// Longest sleep, bounds error from clock drift
+
+// Burst sampling when power changes sharply, such as passing clouds or shadows
+#define SOL_BURST_SAMPLING													// Comment out to keep the base rate
+#define BURST_HISTORY_LENGTH							4					// Number of recent samples compared against
+#define BURST_CHANGE_FRACTION							0.25				// Change from recent mean that starts a burst
+#define BURST_CHANGE_FLOOR_MW							10.0				// Power changes below this never start a burst
+#define BURST_SLEEP_SECONDS								10					// Sleep time during a burst
+#define BURST_SAMPLE_COUNT								6					// Samples to keep bursting after the last sharp change
 #define PROVISION_TIMEOUT								180					// WiFi provisioning timeout
 
+// Sparse sweep, finds peak power by fitting a few operating points instead of sweeping every DAC value
+#define SOL_SPARSE_SWEEP													// Comment out to run the full sweep
+#define SPARSE_COARSE_POINTS							9					// Points spread from open circuit to short circuit
+#define SPARSE_REFINE_POINTS							4					// Extra points around the best coarse point
+#define SPARSE_MIN_CONFIDENCE							0.95				// Fits below this R squared fall back to a dense local search
+#define SPARSE_MAX_PEAK_RATIO							1.1					// Fitted peaks further above the best point fall back too
+#define SPARSE_GAIN_HEADROOM							0.9					// Fraction of ADC range a reading may use after raising gain
+
+// I-V curve capture for shading diagnosis, uploaded separately from data
+#define SOL_CURVE_CAPTURE													// Comment out to never capture curves
+#define CURVE_CAPTURE_INTERVAL_SECONDS					3600				// Time between curve captures
+#define CURVE_POINTS									32					// Points per curve, evenly spaced in DAC value
+
+// Reference cells on a spare ADS1015 input, measured every sample to compare orientations at the site
+// More than one cell needs an analog mux between the cells and REF_CELL_CHANNEL, selected by REF_CELL_MUX_PINS
+//#define SOL_REF_CELLS														// Uncomment when reference cells are fitted
+#define REF_CELL_CHANNEL								3					// ADS1015 input the cells are read on
+#define REF_CELL_COUNT									1					// Number of cells, at most 2^REF_CELL_MUX_BITS
+#define REF_CELL_MUX_BITS								0					// Number of mux select lines
+#define REF_CELL_MUX_PINS								{27, 14}			// Mux select GPIOs, least significant first
+#define REF_CELL_MUX_SETTLE_MS							2					// Time for the mux and ADC input to settle after switching
+#define REF_CELL_W_M2_PER_V								{10000.0}			// Irradiance per volt across each cell's shunt, from its calibration
+
+// Daily energy summaries, aggregated from every sample and uploaded one record per day
+#define SOL_DAILY_SUMMARY													// Comment out to never aggregate
+//#define SOL_UPLOAD_SUMMARIES_ONLY											// Upload summaries instead of datapoints, for low bandwidth sites
+#define SUMMARY_PENDING_COUNT							7					// Finished days kept for upload, the oldest is dropped when full
+#define SUMMARY_MAX_GAP_SECONDS							5400				// Longer gaps between samples, such as the night, add no energy
+#define SUMMARY_ABOVE_THRESHOLD_MW						100.0				// Power counted toward minutes above threshold
+#define SUMMARY_HISTOGRAM_BINS							8					// Power histogram bins
+#define SUMMARY_HISTOGRAM_BASE_MW						10.0				// Upper edge of the lowest bin, each further bin's edge doubles
+
+// Data log in a flash partition instead of the EEPROM, holding weeks of samples through network outages
+// NOTE: needs a partition table with a FLASH_LOG_PARTITION_LABEL data partition, such as partitions.csv
+//#define SOL_FLASH_LOG
+#define FLASH_LOG_PARTITION_LABEL						"sollog"
+#define FLASH_LOG_PARTITION_SUBTYPE						0x40				// Custom data partition subtype
+
+// Wake on the MCP7940 alarm instead of the ESP32 timer, which drifts with the ESP32 slow clock
+// NOTE: R2 boards need the MCP7940 MFP pin wired to RTC_MFP_PIN with a 10k pull-up to 3.3V
+//#define SOL_RTC_ALARM_WAKE
+#define RTC_ALARM_ALIGN_SECONDS							10					// Alarm wakes are rounded up to this wall clock boundary
+#define RTC_ALARM_BACKSTOP_SECONDS						60					// ESP32 timer wakes this long after a missed alarm
+
+// Upload server. NOTE: Put your own server here
+// Data is posted in batches and the server responds with {"ack":N}, the highest sequence number stored
+// Any response may also carry new duty cycle settings, see SOL_config.h
+#define SOL_UPLOAD_SERVER								"your.server.com"
+#define SOL_UPLOAD_PORT									80
+#define SOL_UPLOAD_RESOURCE								"/sol/upload"
+#define SOL_PROFILE_RESOURCE							"/sol/profile"
+#define SOL_TRACE_RESOURCE								"/sol/trace"
+#define SOL_CURVE_RESOURCE								"/sol/curve"
+#define SOL_SUMMARY_RESOURCE							"/sol/summary"
+#define UPLOAD_BATCH_SIZE								8					// Number of datapoints per upload request
+
+// Firmware updates, fetched as a delta against the running image a few chunks per upload session
+// NOTE: needs two OTA app partitions, as in the default partition table and partitions.csv
+#define SOL_FIRMWARE_VERSION							1					// Raise for every release, the server offers updates by it
+#define SOL_OTA																// Comment out to never update
+#define SOL_OTA_RESOURCE								"/sol/ota"
+#define OTA_CHUNK_SIZE									2048				// Delta bytes per request
+#define OTA_CHUNKS_PER_SESSION							16					// Requests per upload session, the rest waits for the next
+
 // Only charge in certain temperature range
 #define CHARGE_TEMP_MIN_CELSIUS							0
 #define CHARGE_TEMP_MAX_CELSIUS							45
 #define TEMP_SENSE_OFFSET_C								0.5		// V
 #define TEMP_SENSE_COEFF								0.01 	// V/C
+#define CHARGE_MIN_POWER_MW								50.0	// Panel power above which the battery is considered charging
+
+// Upload policy, uploads preferably happen midday while charging and are deferred on low battery
+#define UPLOAD_MAX_DEFER_COUNT							48					// Upload regardless once this many datapoints are waiting
+#define UPLOAD_FULL_FRACTION							0.8					// Upload regardless once the log is this full
+#define UPLOAD_MIDDAY_WINDOW_SECONDS					10800				// Uploads while charging within this long of solar noon
+#define UPLOAD_LOW_BATT_V								3.5					// Below this, only upload when the log is nearly full
+#define UPLOAD_CRITICAL_BATT_V							3.3					// Below this, never upload
+
+// Power modes, each entered below its battery voltage and left above it plus POWER_HYSTERESIS_V
+#define POWER_REDUCED_BATT_V							3.7					// Sparse sweep only, no curves, longer sleeps
+#define POWER_LOG_ONLY_BATT_V							3.55				// Keep logging but never use the radio
+#define POWER_SURVIVAL_BATT_V							3.4					// Stop sampling, only wake to check the battery
+#define POWER_HYSTERESIS_V								0.1
+#define POWER_CHARGING_RISE_V							0.1					// Extra margin to leave a mode while charging raises the reading
+#define POWER_REDUCED_SLEEP_FACTOR						2
+#define POWER_LOG_ONLY_SLEEP_FACTOR						4
+#define POWER_SURVIVAL_SLEEP_SECONDS					3600				// Shortest sleep in survival mode
+
+// Backoff after failed WiFi connects, doubling each failure
+#define WIFI_BACKOFF_BASE_SECONDS						300					// Wait after the first failure
+#define WIFI_BACKOFF_MAX_SECONDS						21600				// Longest wait between attempts
+#define WIFI_BACKOFF_JITTER_PERCENT						20					// Random extra wait, so a site's units don't retry together
+
+// Bounds on duty cycle settings sent by the server, see SOL_config.h
+#define CONFIG_SLEEP_MIN_SECONDS						10
+#define CONFIG_SLEEP_MAX_SECONDS						1200				// Still within SUMMARY_MAX_GAP_SECONDS in log only mode
+#define CONFIG_COUNT_MAX								1000
+#define CONFIG_TEMP_MIN_CELSIUS							-20
+#define CONFIG_TEMP_MAX_CELSIUS							60
+#define CONFIG_POWER_MAX_MW								5000.0
+#define CONFIG_BATT_MIN_V								3.0
+#define CONFIG_BATT_MAX_V								4.2
+
+// Timekeeping, NTP is only requested once the predicted time error passes TIME_MAX_ERROR_SECONDS
+#define TIME_MAX_ERROR_SECONDS							5.0
+#define TIME_NTP_ERROR_SECONDS							1.0					// Time error right after NTP, time is kept in whole seconds
+#define TIME_RTC_ERROR_SECONDS							1.0					// Extra error from reading the RTC in whole seconds
+#define TIME_RTC_DRIFT_PPM								20.0				// MCP7940 crystal tolerance
+#define TIME_DRIFT_DEFAULT_PPM							1000.0				// ESP32 slow clock error before it has been measured
+#define TIME_DRIFT_MIN_PPM								50.0				// Smallest drift uncertainty assumed
+#define TIME_DRIFT_MIN_INTERVAL_SECONDS					3600				// Shortest interval drift is measured over
+#define TIME_DRIFT_GAIN									0.5					// Weight of a new drift measurement
+
+// CPU frequency for each wake phase, MHz. Valid values are 240, 160, 80 (and 40, 20, 10 with 40MHz crystal)
+// Below 80MHz the APB clock drops as well, slowing I2C and UART, so I2C bound phases stay at 80MHz
+#define SOL_CPU_SCALING														// Comment out to run at default clock for comparison
+#define CPU_FREQ_MHZ_MIN								80
+#define CPU_FREQ_MHZ_BOOT								80
+#define CPU_FREQ_MHZ_CREDENTIALS						80
+#define CPU_FREQ_MHZ_SWEEP								80
+#define CPU_FREQ_MHZ_STORAGE							80
+#define CPU_FREQ_MHZ_CONNECT							160
+#define CPU_FREQ_MHZ_UPLOAD								240
+#define CPU_FREQ_MHZ_NTP								160
+#define CPU_FREQ_MHZ_SLEEP								80
+#define CPU_FREQ_MHZ_OTA								160
+
+// Deadline for each wake phase, ms. Phases check it between steps and stop early, leaving unsent data for later
+// A full wake must fit in WAKE_BUDGET_MS less WAKE_BUDGET_MARGIN_MS, with sweep and storage entered twice for a curve
+#define PHASE_DEADLINE_MS_BOOT							1000
+#define PHASE_DEADLINE_MS_CREDENTIALS					500
+#define PHASE_DEADLINE_MS_SWEEP							3000
+#define PHASE_DEADLINE_MS_STORAGE						1000
+#define PHASE_DEADLINE_MS_CONNECT						8000
+#define PHASE_DEADLINE_MS_UPLOAD						10000
+#define PHASE_DEADLINE_MS_NTP							4000
+#define PHASE_DEADLINE_MS_SLEEP							1000
+#define PHASE_DEADLINE_MS_OTA							5000
+// Hard limit for a whole wake, for code stuck where no deadline is checked. Not applied while provisioning
+#define WAKE_BUDGET_MS									40000
+#define WAKE_BUDGET_MARGIN_MS							2000				// Left for time between phase deadline checks
+#define WAKE_OVERRUN_SLEEP_SECONDS						SLEEP_TIME_SECONDS	// Sleep time after a wake is cut off
 
 /**
  * @brief Data packet generated by SOL during each sensing cycle
@@ -90,8 +256,85 @@ typedef struct data_packet_t
 	float temp_celsius;
 	float batt_v;
 	uint32_t ID;
+	uint32_t seq;			// Sequence number, acknowledged by the server
+	float confidence;		// Confidence in peak power, R squared of the MPP fit or 1 for a full sweep
+	#ifdef SOL_REF_CELLS
+	float ref_W_m2[REF_CELL_COUNT];	// Irradiance at each reference cell
+	#endif
 } data_packet_t;
 
+/**
+ * @brief Board traits for R2, specializing the shared firmware core in SOL_board.h
+ */
+struct SOL_board_R2
+{
+	static constexpr uint8_t EEPROM_I2C_ADDRESS = EEPROM_ADDRESS;
+	static constexpr uint16_t EEPROM_PAGE_SIZE = 32;					// 24AA32
+	static constexpr uint8_t EEPROM_WRITE_MS = 5;
+	static constexpr uint16_t LOG_START = EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS;
+	static constexpr uint16_t LOG_END = EEPROM_ADDRESS_DATA_RANGE_END_ADDRESS;
+	static constexpr bool HAS_RTC = true;								// MCP7940
+	static constexpr uint16_t DAC_STEPS = DAC_RANGE;
+	static constexpr uint8_t SWEEP_GAIN_COUNT = 3;
+
+	// Volts and amps per ADS1015 count at each gain, the ADC full scale halves with each gain step
+	static constexpr float V_SCALE[5] = {
+		SOL_voltsPerCount(4.096, AD1015_RANGE, V_SENSE_AMPLIFICATION),
+		SOL_voltsPerCount(2.048, AD1015_RANGE, V_SENSE_AMPLIFICATION),
+		SOL_voltsPerCount(1.024, AD1015_RANGE, V_SENSE_AMPLIFICATION),
+		SOL_voltsPerCount(0.512, AD1015_RANGE, V_SENSE_AMPLIFICATION),
+		SOL_voltsPerCount(0.256, AD1015_RANGE, V_SENSE_AMPLIFICATION)};
+	static constexpr float I_SCALE[5] = {
+		SOL_ampsPerCount(4.096, AD1015_RANGE, R_SENSE, I_SENSE_AMPLIFICATION),
+		SOL_ampsPerCount(2.048, AD1015_RANGE, R_SENSE, I_SENSE_AMPLIFICATION),
+		SOL_ampsPerCount(1.024, AD1015_RANGE, R_SENSE, I_SENSE_AMPLIFICATION),
+		SOL_ampsPerCount(0.512, AD1015_RANGE, R_SENSE, I_SENSE_AMPLIFICATION),
+		SOL_ampsPerCount(0.256, AD1015_RANGE, R_SENSE, I_SENSE_AMPLIFICATION)};
+
+	/**
+	 * @brief Reads the raw panel voltage and current ADC counts at one DAC setting
+	 *
+	 * @param dac The DAC value setting the load
+	 * @param v_gain_idx Index into the ADS1015 gains for the voltage reading
+	 * @param i_gain_idx Index into the ADS1015 gains for the current reading
+	 * @param voltage_raw Pointer to put the voltage reading in
+	 * @param current_raw Pointer to put the current reading in
+	 *
+	 */
+	static void readPointRaw(uint8_t dac, uint8_t v_gain_idx, uint8_t i_gain_idx, int16_t * voltage_raw, int16_t * current_raw);
+};
+typedef SOL_board_R2 SOL_board;
+
+/**
+ * @brief I-V curve, ADC counts delta compressed into signed bytes
+ */
+typedef struct iv_curve_t
+{
+	uint32_t timestamp;
+	uint32_t seq;			// Sequence number of the data packet taken with the curve
+	uint8_t uploaded;
+	uint8_t v_gain_idx;
+	uint8_t i_gain_idx;
+	uint8_t shift;			// Deltas are scaled down by this right shift
+	int16_t v0;				// First voltage reading, at open circuit
+	int16_t i0;				// First current reading, at open circuit
+	int8_t deltas[2 * (CURVE_POINTS - 1)];	// Voltage and current deltas, interleaved
+} iv_curve_t;
+
+/**
+ * @brief Energy summary of one day, 36 bytes instead of one data packet per sample
+ */
+typedef struct daily_summary_t
+{
+	uint32_t day;			// Local mean solar days since January 1st, 1970
+	float energy_mWh;		// Peak power integrated over the day
+	float min_power_mW;
+	float max_power_mW;
+	uint16_t samples;
+	uint16_t minutes_above;	// Minutes with power above SUMMARY_ABOVE_THRESHOLD_MW
+	uint16_t histogram_minutes[SUMMARY_HISTOGRAM_BINS];	// Minutes in each power bin
+} daily_summary_t;
+
 /**
  * @brief Performs initialization for SOL
  *
@@ -127,7 +370,10 @@ uint8_t SOL_connectToWiFi(uint16_t timeout);
 void SOL_startProvisioning(void);
 
 /**
- * @brief Uploads all available data from EEPROM
+ * @brief Uploads data from EEPROM in batches, resuming from the oldest unacknowledged record
+ *
+ * 	The log tail only moves past records the server acknowledged, so an interrupted
+ * 	upload resends from where it stopped and nothing is lost
  *
  */
 void SOL_upload(void);
@@ -147,22 +393,57 @@ void SOL_deepsleep(int len);
 void SOL_generateDataPacket(void);
 
 /**
- * @brief Gets data packet stored in EEPROM
+ * @brief Uploads a batch of data packets and gets the server acknowledgement
+ *
+ * 	Records are sent with their sequence numbers. The server responds with
+ * 	{"ack":N}, the highest sequence number it has stored, and possibly new settings for SOL_config.h.
+ *
+ * @param data Pointer to the data packets to upload
+ * @param count The number of data packets
+ * @param ack Pointer to put the acknowledged sequence number in
+ *
+ * @return 1 if the server acknowledged, otherwise 0
+ *
+ */
+uint8_t SOL_uploadDataPackets(data_packet_t * data, uint8_t count, uint32_t * ack);
+
+/**
+ * @brief Uploads the wake cycle phase profile, starting a new profiling interval once received
  *
- * @param start_address The starting location for the data packet struct
+ */
+void SOL_uploadProfile(void);
+
+/**
+ * @brief Uploads the stored I-V curve if it has not been uploaded yet
+ *
+ * 	The curve is sent as stored, with scales to turn ADC counts into volts and amps.
+ * 	Point k is v0 + (sum of the first k voltage deltas << shift), likewise for current.
+ *
+ */
+void SOL_uploadCurve(void);
+
+/**
+ * @brief Uploads the finished daily summaries, dropping those the server acknowledges
+ *
+ * 	The server responds with {"ack":N}, the last day it has stored.
  *
- * @return The data packet
+ */
+void SOL_uploadSummaries(void);
+
+/**
+ * @brief Uploads the binary trace log, decode with tools/sol_trace_decode.py
  *
  */
-data_packet_t SOL_getDataPacket(uint16_t start_address);
+void SOL_uploadTrace(void);
 
 /**
- * @brief Uploads an individual data packet
+ * @brief Downloads and applies the next chunks of an offered firmware update
  *
- * @param data Pointer to data packet to upload
+ * 	Stops after OTA_CHUNKS_PER_SESSION requests or at the phase deadline, the rest is
+ * 	fetched in later sessions. Restarts into the new firmware once it is verified.
  *
  */
-void SOL_uploadDataPacket(data_packet_t * data);
+void SOL_updateFirmware(void);
 
 /**
  * @brief Writes a single byte to EEPROM
@@ -211,6 +492,16 @@ void SOL_readEEPROMNByte(uint16_t address, uint8_t * data, uint16_t size);
  */
 float get_temperature_C(void);
 
+/**
+ * @brief Checks if the battery may be charged at a temperature
+ *
+ * @param temp_C The temperature in celsius
+ *
+ * @return 1 if charging is allowed, otherwise 0
+ *
+ */
+uint8_t SOL_chargeAllowed(float temp_C);
+
 /**
  * @brief Reads the battery voltage
  *
@@ -219,6 +510,16 @@ float get_temperature_C(void);
  */
 float get_battery_voltage(void);
 
+/**
+ * @brief Reads the irradiance at a reference cell, selecting it on the mux first
+ *
+ * @param cell The reference cell, less than REF_CELL_COUNT
+ *
+ * @return The irradiance in W/m2
+ *
+ */
+float get_reference_irradiance(uint8_t cell);
+
 /**
  * @brief Sets time from network time protocol server
  */
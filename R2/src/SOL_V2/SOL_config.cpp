@@ -0,0 +1,214 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_config.cpp
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Duty cycle settings for SOL_V2, stored in EEPROM and updated by the server
+ */
+
+#include <Arduino.h>
+#include <limits>
+#include <SOL_crc.h>
+
+#include "SOL_V2.h"
+#include "SOL_config.h"
+#include "SOL_trace.h"
+
+static_assert(sizeof(SOL_config_t) == EEPROM_ADDRESS_CONFIG_END - EEPROM_ADDRESS_CONFIG_START + 1, "Settings do not fill their EEPROM page");
+static_assert(CONFIG_SLEEP_MAX_SECONDS * POWER_LOG_ONLY_SLEEP_FACTOR <= SUMMARY_MAX_GAP_SECONDS, "Longest daytime sleep would leave gaps the daily summary drops");
+
+// Kept through deep sleep, so EEPROM is only read once per power on
+RTC_DATA_ATTR SOL_config_t config;
+RTC_DATA_ATTR uint8_t configLoaded = 0;
+
+/**
+ * @brief Fills in the compile time defaults
+ *
+ * @param cfg Pointer to the settings
+ *
+ */
+static void SOL_configDefaults(SOL_config_t * cfg)
+{
+	memset(cfg, 0, sizeof(SOL_config_t));
+	cfg->format = SOL_CONFIG_FORMAT;
+	cfg->version = 0;
+	cfg->sleep_s = SCHEDULE_NOON_SLEEP_SECONDS;
+	cfg->edge_sleep_s = SCHEDULE_EDGE_SLEEP_SECONDS;
+	cfg->night_sleep_s = NIGHT_SLEEP_TIME_SECONDS;
+	cfg->send_count = SENSE_COUNT_TO_SEND;
+	cfg->max_defer_count = UPLOAD_MAX_DEFER_COUNT;
+	cfg->charge_temp_min_C = CHARGE_TEMP_MIN_CELSIUS;
+	cfg->charge_temp_max_C = CHARGE_TEMP_MAX_CELSIUS;
+	cfg->charge_min_power_mW = CHARGE_MIN_POWER_MW;
+	cfg->upload_low_batt_v = UPLOAD_LOW_BATT_V;
+	cfg->upload_critical_batt_v = UPLOAD_CRITICAL_BATT_V;
+}
+
+/**
+ * @brief Checks every setting is within its bounds
+ *
+ * @param cfg Pointer to the settings
+ *
+ * @return 1 if the settings are usable, otherwise 0
+ */
+static uint8_t SOL_configValid(const SOL_config_t * cfg)
+{
+	return cfg->sleep_s >= CONFIG_SLEEP_MIN_SECONDS && cfg->sleep_s <= CONFIG_SLEEP_MAX_SECONDS
+		&& cfg->edge_sleep_s >= cfg->sleep_s && cfg->edge_sleep_s <= CONFIG_SLEEP_MAX_SECONDS
+		&& cfg->night_sleep_s >= CONFIG_SLEEP_MIN_SECONDS && cfg->night_sleep_s <= SCHEDULE_MAX_SLEEP_SECONDS
+		&& cfg->send_count >= 1 && cfg->send_count <= CONFIG_COUNT_MAX
+		&& cfg->max_defer_count >= cfg->send_count && cfg->max_defer_count <= CONFIG_COUNT_MAX
+		&& cfg->charge_temp_min_C >= CONFIG_TEMP_MIN_CELSIUS && cfg->charge_temp_max_C <= CONFIG_TEMP_MAX_CELSIUS
+		&& cfg->charge_temp_min_C < cfg->charge_temp_max_C
+		&& cfg->charge_min_power_mW >= 0.0 && cfg->charge_min_power_mW <= CONFIG_POWER_MAX_MW
+		&& cfg->upload_critical_batt_v >= CONFIG_BATT_MIN_V && cfg->upload_low_batt_v <= CONFIG_BATT_MAX_V
+		&& cfg->upload_critical_batt_v <= cfg->upload_low_batt_v;
+}
+
+/**
+ * @brief Gets the settings in use, loading them from EEPROM once per power on
+ *
+ * @return Pointer to the settings
+ */
+const SOL_config_t * SOL_config(void)
+{
+	if(!configLoaded)
+	{
+		SOL_readEEPROMNByte(EEPROM_ADDRESS_CONFIG_START, (uint8_t *) &config, sizeof(SOL_config_t));
+
+		// Never written, from older firmware, or cut short while written
+		if(config.format != SOL_CONFIG_FORMAT
+			|| config.crc != SOL_crc16((const uint8_t *) &config, offsetof(SOL_config_t, crc))
+			|| !SOL_configValid(&config))
+		{
+			SOL_configDefaults(&config);
+		}
+		configLoaded = 1;
+	}
+
+	return &config;
+}
+
+/**
+ * @brief Finds a number in the config object of a response
+ *
+ * @param response The server response
+ * @param start Index of the config object
+ * @param end Index of the end of the config object
+ * @param key The field name
+ * @param value Pointer to put the number in, left as it is if the field is missing
+ *
+ */
+static void SOL_configField(const String & response, int start, int end, const char * key, float * value)
+{
+	String pattern = String("\"") + key + "\":";
+	int idx = response.indexOf(pattern, start);
+	if(idx >= 0 && idx < end)
+	{
+		*value = strtod(response.c_str() + idx + pattern.length(), NULL);
+	}
+}
+
+/**
+ * @brief Finds an integer setting in the config object of a response
+ *
+ * @param response The server response
+ * @param start Index of the config object
+ * @param end Index of the end of the config object
+ * @param key The field name
+ * @param value Pointer to put the setting in, left as it is if the field is missing
+ *
+ * @return 0 if the number is not a whole number that fits the setting, otherwise 1
+ */
+template<class T>
+static uint8_t SOL_configIntField(const String & response, int start, int end, const char * key, T * value)
+{
+	static_assert(sizeof(T) <= 2, "Integer settings must be exact in a float");
+
+	float f = *value;
+	SOL_configField(response, start, end, key, &f);
+	if(!(f >= (float) std::numeric_limits<T>::min() && f <= (float) std::numeric_limits<T>::max()) || (float) (T) f != f)
+	{
+		return 0;
+	}
+	*value = (T) f;
+	return 1;
+}
+
+/**
+ * @brief Applies settings piggybacked on an upload response, if they are newer and in bounds
+ *
+ * @param response The server response
+ *
+ * @return 1 if new settings were stored, otherwise 0
+ */
+uint8_t SOL_configUpdate(const String & response)
+{
+	int start = response.indexOf("\"config\":{");
+	if(start < 0)
+	{
+		return 0;
+	}
+	int end = response.indexOf('}', start);
+	if(end < 0)
+	{
+		return 0;
+	}
+
+	// Only move forward, so a stale response can't undo a newer update
+	float version = 0.0;
+	SOL_configField(response, start, end, "version", &version);
+	if(version < 1.0 || version > 65535.0 || (int16_t) ((uint16_t) version - SOL_config()->version) <= 0)
+	{
+		return 0;
+	}
+
+	SOL_config_t cfg = *SOL_config();
+	cfg.version = (uint16_t) version;
+	uint8_t whole = SOL_configIntField(response, start, end, "sleep", &cfg.sleep_s)
+		& SOL_configIntField(response, start, end, "edge_sleep", &cfg.edge_sleep_s)
+		& SOL_configIntField(response, start, end, "night_sleep", &cfg.night_sleep_s)
+		& SOL_configIntField(response, start, end, "send_count", &cfg.send_count)
+		& SOL_configIntField(response, start, end, "max_defer", &cfg.max_defer_count)
+		& SOL_configIntField(response, start, end, "charge_temp_min", &cfg.charge_temp_min_C)
+		& SOL_configIntField(response, start, end, "charge_temp_max", &cfg.charge_temp_max_C);
+	SOL_configField(response, start, end, "charge_min_power", &cfg.charge_min_power_mW);
+	SOL_configField(response, start, end, "upload_low_batt", &cfg.upload_low_batt_v);
+	SOL_configField(response, start, end, "upload_critical_batt", &cfg.upload_critical_batt_v);
+
+	if(!whole || !SOL_configValid(&cfg))
+	{
+		SOL_TRACE_WARN(SOL_TRACE_CONFIG, cfg.version, 0);
+		return 0;
+	}
+
+	cfg.crc = SOL_crc16((const uint8_t *) &cfg, offsetof(SOL_config_t, crc));
+	SOL_writeEEPROMNByte(EEPROM_ADDRESS_CONFIG_START, (uint8_t *) &cfg, sizeof(SOL_config_t));
+	config = cfg;
+
+	SOL_TRACE_INFO(SOL_TRACE_CONFIG, cfg.version, 1);
+	return 1;
+}
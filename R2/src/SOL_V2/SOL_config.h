@@ -0,0 +1,95 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_config.h
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Duty cycle settings for SOL_V2, stored in EEPROM and updated by the server
+ *
+ * 	The defaults are the #defines in SOL_V2.h. The server can send newer settings in any upload
+ * 	response, as {"ack":N,"config":{"version":V,"sleep":60,...}}. Fields left out keep their value,
+ * 	and the whole update is refused if any field is out of bounds. Uploads report the version
+ * 	in use as "cfg", so the server knows when a unit needs the latest.
+ *
+ * 	Field				Setting						Bounds
+ * 	sleep				Sleep around solar noon		CONFIG_SLEEP_MIN_SECONDS to CONFIG_SLEEP_MAX_SECONDS
+ * 	edge_sleep			Sleep at sunrise and sunset	sleep to CONFIG_SLEEP_MAX_SECONDS
+ * 	night_sleep			Sleep when the panel is dark	CONFIG_SLEEP_MIN_SECONDS to SCHEDULE_MAX_SLEEP_SECONDS
+ * 	send_count			Datapoints worth uploading	1 to CONFIG_COUNT_MAX
+ * 	max_defer			Upload regardless count		send_count to CONFIG_COUNT_MAX
+ * 	charge_temp_min		Lowest charging temperature	CONFIG_TEMP_MIN_CELSIUS to charge_temp_max
+ * 	charge_temp_max		Highest charging temperature	charge_temp_min to CONFIG_TEMP_MAX_CELSIUS
+ * 	charge_min_power	Power counted as charging	0 to CONFIG_POWER_MAX_MW
+ * 	upload_low_batt		Defer uploads below			upload_critical_batt to CONFIG_BATT_MAX_V
+ * 	upload_critical_batt	Never upload below			CONFIG_BATT_MIN_V to upload_low_batt
+ */
+
+
+#ifndef SOL_config_h
+#define SOL_config_h
+
+#include <Arduino.h>
+
+#define SOL_CONFIG_FORMAT					1					// Change when SOL_config_t changes, stored settings are then ignored
+
+/**
+ * @brief Duty cycle settings, 32 bytes so it fits one EEPROM page
+ */
+typedef struct SOL_config_t
+{
+	uint8_t format;						// SOL_CONFIG_FORMAT
+	uint8_t reserved;
+	uint16_t version;					// Set by the server, 0 for the defaults
+	uint16_t sleep_s;
+	uint16_t edge_sleep_s;
+	uint16_t night_sleep_s;
+	uint16_t send_count;
+	uint16_t max_defer_count;
+	int8_t charge_temp_min_C;
+	int8_t charge_temp_max_C;
+	float charge_min_power_mW;
+	float upload_low_batt_v;
+	float upload_critical_batt_v;
+	uint16_t reserved2;
+	uint16_t crc;						// CRC of everything before it
+} SOL_config_t;
+
+/**
+ * @brief Gets the settings in use, loading them from EEPROM once per power on
+ *
+ * @return Pointer to the settings
+ */
+const SOL_config_t * SOL_config(void);
+
+/**
+ * @brief Applies settings piggybacked on an upload response, if they are newer and in bounds
+ *
+ * @param response The server response
+ *
+ * @return 1 if new settings were stored, otherwise 0
+ */
+uint8_t SOL_configUpdate(const String & response);
+
+#endif
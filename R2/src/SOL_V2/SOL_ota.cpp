@@ -0,0 +1,565 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_ota.cpp
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Firmware updates for SOL_V2, downloaded as a delta against the running image
+ */
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <esp_ota_ops.h>
+#include <mbedtls/sha256.h>
+
+#include "SOL_V2.h"
+#include "SOL_ota.h"
+#include "SOL_phase.h"
+#include "SOL_trace.h"
+
+#define OTA_COPY_BLOCK_SIZE			256					// Bytes copied from the running image at a time
+#define OTA_HASH_BLOCK_SIZE			1024				// Bytes hashed at a time
+
+/**
+ * @brief Progress through a delta, kept through deep sleep
+ */
+typedef struct SOL_ota_state_t
+{
+	uint8_t active;
+	uint8_t op;									// Operation being read, 0 between operations
+	uint8_t arg_fill;							// Bytes of the operation's arguments read so far
+	uint8_t args[8];
+	uint32_t version;
+	uint32_t patch_size;
+	uint32_t patch_offset;						// Delta bytes applied
+	uint32_t target_written;					// Image bytes written
+	uint32_t copy_source;						// Next source byte of a copy cut short by the phase deadline
+	uint32_t remaining;							// Bytes left in the current copy or insert
+	uint8_t header[SOL_OTA_HEADER_SIZE];
+} SOL_ota_state_t;
+
+RTC_DATA_ATTR SOL_ota_state_t ota_state;
+
+// Last update that could never succeed, so repeat offers of it are not downloaded again
+RTC_DATA_ATTR uint32_t ota_rejected_version = 0;
+RTC_DATA_ATTR uint32_t ota_rejected_size = 0;
+
+// The running image's rollback state, read from flash once per wake, -1 until then
+static int8_t ota_unconfirmed = -1;
+
+/**
+ * @brief Reads a little endian 32 bit number
+ *
+ * @param data Pointer to the bytes
+ *
+ * @return The number
+ */
+static uint32_t SOL_otaRead32(const uint8_t * data)
+{
+	return (uint32_t) data[0] | ((uint32_t) data[1] << 8) | ((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+/**
+ * @brief Hashes the start of a partition
+ *
+ * @param partition The partition
+ * @param size The number of bytes to hash
+ * @param hash Pointer to put the 32 byte SHA-256 in
+ *
+ * @return 1 if the partition was read, otherwise 0
+ */
+static uint8_t SOL_otaHash(const esp_partition_t * partition, uint32_t size, uint8_t * hash)
+{
+	uint8_t buffer[OTA_HASH_BLOCK_SIZE];
+	mbedtls_sha256_context ctx;
+	mbedtls_sha256_init(&ctx);
+	mbedtls_sha256_starts_ret(&ctx, 0);
+
+	uint8_t ok = 1;
+	for(uint32_t offset = 0; offset < size && ok; offset += OTA_HASH_BLOCK_SIZE)
+	{
+		uint32_t chunk = (size - offset > OTA_HASH_BLOCK_SIZE) ? OTA_HASH_BLOCK_SIZE : size - offset;
+		ok = esp_partition_read(partition, offset, buffer, chunk) == ESP_OK;
+		mbedtls_sha256_update_ret(&ctx, buffer, chunk);
+	}
+
+	mbedtls_sha256_finish_ret(&ctx, hash);
+	mbedtls_sha256_free(&ctx);
+	return ok;
+}
+
+/**
+ * @brief Abandons the update with a trace event
+ *
+ * @param step What failed, see SOL_TRACE_OTA_ERROR
+ * @param offset The delta offset it failed at
+ *
+ * @return 0
+ */
+static uint8_t SOL_otaFail(uint8_t step, uint32_t offset)
+{
+	SOL_TRACE_WARN(SOL_TRACE_OTA_ERROR, step, offset);
+	SOL_otaAbort();
+	return 0;
+}
+
+/**
+ * @brief Abandons an update that would fail the same way again, ignoring later offers of it
+ *
+ * @param state Pointer to the update progress
+ * @param step What failed, see SOL_TRACE_OTA_ERROR
+ *
+ * @return 0
+ */
+static uint8_t SOL_otaReject(const SOL_ota_state_t * state, uint8_t step)
+{
+	ota_rejected_version = state->version;
+	ota_rejected_size = state->patch_size;
+	return SOL_otaFail(step, state->patch_offset);
+}
+
+/**
+ * @brief Checks a complete delta header against the running image and the spare partition
+ *
+ * @param state Pointer to the update progress
+ * @param source The running app partition
+ * @param target The spare app partition
+ *
+ * @return 1 if the delta applies to the running image and fits, otherwise 0
+ */
+static uint8_t SOL_otaCheckHeader(const SOL_ota_state_t * state, const esp_partition_t * source, const esp_partition_t * target)
+{
+	uint32_t source_size = SOL_otaRead32(&state->header[4]);
+	uint32_t target_size = SOL_otaRead32(&state->header[40]);
+
+	if(memcmp(state->header, SOL_OTA_MAGIC, 4) != 0 || target_size == 0 || target_size > target->size)
+	{
+		return SOL_otaReject(state, 0);
+	}
+
+	// A delta built against any other image would produce garbage
+	uint8_t hash[32];
+	if(source_size > source->size || !SOL_otaHash(source, source_size, hash) || memcmp(hash, &state->header[8], 32) != 0)
+	{
+		return SOL_otaReject(state, 1);
+	}
+
+	// The bootloader already rolled back from this image, it would only do so again
+	if(esp_ota_get_last_invalid_partition() == target
+		&& SOL_otaHash(target, target_size, hash) && memcmp(hash, &state->header[44], 32) == 0)
+	{
+		return SOL_otaReject(state, 6);
+	}
+
+	return 1;
+}
+
+/**
+ * @brief Writes image bytes to the spare partition, erasing each sector as it is reached
+ *
+ * @param state Pointer to the update progress
+ * @param target The spare app partition
+ * @param data Pointer to the bytes
+ * @param size The number of bytes
+ *
+ * @return 1 if the bytes were written, otherwise 0
+ */
+static uint8_t SOL_otaTargetWrite(SOL_ota_state_t * state, const esp_partition_t * target, const uint8_t * data, uint32_t size)
+{
+	if(state->target_written + size > SOL_otaRead32(&state->header[40]))
+	{
+		return 0;
+	}
+
+	while(size > 0)
+	{
+		uint32_t in_sector = state->target_written % SPI_FLASH_SEC_SIZE;
+		if(in_sector == 0 && esp_partition_erase_range(target, state->target_written, SPI_FLASH_SEC_SIZE) != ESP_OK)
+		{
+			return 0;
+		}
+
+		uint32_t chunk = (size > SPI_FLASH_SEC_SIZE - in_sector) ? SPI_FLASH_SEC_SIZE - in_sector : size;
+		if(esp_partition_write(target, state->target_written, data, chunk) != ESP_OK)
+		{
+			return 0;
+		}
+		state->target_written += chunk;
+		data += chunk;
+		size -= chunk;
+	}
+
+	return 1;
+}
+
+/**
+ * @brief Checks if a copy has all its arguments but has not finished
+ *
+ * @param state Pointer to the update progress
+ *
+ * @return 1 if a copy is under way, otherwise 0
+ */
+static uint8_t SOL_otaCopying(const SOL_ota_state_t * state)
+{
+	return state->op == SOL_OTA_OP_COPY && state->arg_fill == 8;
+}
+
+/**
+ * @brief Continues a copy from the running image until it is done or the phase runs out of time
+ *
+ * @param state Pointer to the update progress
+ * @param source The running app partition
+ * @param target The spare app partition
+ *
+ * @return 1 if no flash access failed, otherwise 0
+ */
+static uint8_t SOL_otaCopy(SOL_ota_state_t * state, const esp_partition_t * source, const esp_partition_t * target)
+{
+	uint8_t buffer[OTA_COPY_BLOCK_SIZE];
+	while(state->remaining > 0 && !SOL_phaseExpired())
+	{
+		uint32_t chunk = (state->remaining > OTA_COPY_BLOCK_SIZE) ? OTA_COPY_BLOCK_SIZE : state->remaining;
+		if(esp_partition_read(source, state->copy_source, buffer, chunk) != ESP_OK
+			|| !SOL_otaTargetWrite(state, target, buffer, chunk))
+		{
+			return 0;
+		}
+		state->copy_source += chunk;
+		state->remaining -= chunk;
+	}
+
+	if(state->remaining == 0)
+	{
+		state->op = 0;
+	}
+	return 1;
+}
+
+/**
+ * @brief Starts or continues an update offered in a server response
+ *
+ * 	An offer of the update already in progress continues it, any other newer version restarts the
+ * 	download. Offers of an update that was rejected are ignored until power is lost.
+ *
+ * @param response The server response
+ *
+ */
+void SOL_otaOffer(const String & response)
+{
+	int idx = response.indexOf("\"ota\":{");
+	if(idx < 0)
+	{
+		return;
+	}
+	int end = response.indexOf('}', idx);
+	int version_idx = response.indexOf("\"version\":", idx);
+	int size_idx = response.indexOf("\"size\":", idx);
+	if(end < 0 || version_idx < 0 || version_idx > end || size_idx < 0 || size_idx > end)
+	{
+		return;
+	}
+
+	uint32_t version = (uint32_t) strtoul(response.c_str() + version_idx + 10, NULL, 10);
+	uint32_t size = (uint32_t) strtoul(response.c_str() + size_idx + 7, NULL, 10);
+
+	// Never downgrade, and never fetch an update again that already failed
+	if(version <= SOL_FIRMWARE_VERSION || size <= SOL_OTA_HEADER_SIZE
+		|| (version == ota_rejected_version && size == ota_rejected_size)
+		|| (ota_state.active && ota_state.version == version && ota_state.patch_size == size))
+	{
+		return;
+	}
+
+	if(esp_ota_get_next_update_partition(NULL) == NULL)
+	{
+		SOL_TRACE_WARN(SOL_TRACE_OTA_ERROR, 3, 0);
+		return;
+	}
+
+	memset(&ota_state, 0, sizeof(SOL_ota_state_t));
+	ota_state.version = version;
+	ota_state.patch_size = size;
+	ota_state.active = 1;
+
+	SOL_TRACE_INFO(SOL_TRACE_OTA_OFFER, version, size);
+}
+
+/**
+ * @brief Checks if an update is being downloaded
+ *
+ * @return 1 if an update is in progress, otherwise 0
+ */
+uint8_t SOL_otaActive(void)
+{
+	return ota_state.active;
+}
+
+/**
+ * @brief Gets the firmware version being downloaded
+ *
+ * @return The version
+ */
+uint32_t SOL_otaVersion(void)
+{
+	return ota_state.version;
+}
+
+/**
+ * @brief Gets the offset in the delta to download next
+ *
+ * @return The offset in bytes
+ */
+uint32_t SOL_otaOffset(void)
+{
+	return ota_state.patch_offset;
+}
+
+/**
+ * @brief Gets the number of delta bytes still to download
+ *
+ * @return The number of bytes
+ */
+uint32_t SOL_otaRemaining(void)
+{
+	return ota_state.patch_size - ota_state.patch_offset;
+}
+
+/**
+ * @brief Checks if the whole delta has been applied
+ *
+ * @return 1 if the update is ready for SOL_otaFinish, otherwise 0
+ */
+uint8_t SOL_otaComplete(void)
+{
+	return ota_state.active && ota_state.patch_offset == ota_state.patch_size && ota_state.op == 0;
+}
+
+/**
+ * @brief Applies the next chunk of the delta
+ *
+ * 	Progress is only kept once the chunk is applied, so a chunk cut short by a reset is applied
+ * 	again from its start. Flash that was already written is written again with the same bytes,
+ * 	which NOR flash allows. Stops early when the phase runs out of time, SOL_otaOffset then
+ * 	gives where to continue. Call with no data to finish a copy once the delta is downloaded.
+ *
+ * @param data Pointer to the chunk, starting at SOL_otaOffset
+ * @param size The number of bytes
+ *
+ * @return 1 if the chunk was applied, 0 if the update failed and was abandoned
+ */
+uint8_t SOL_otaWrite(const uint8_t * data, uint32_t size)
+{
+	SOL_ota_state_t state = ota_state;
+	const esp_partition_t * source = esp_ota_get_running_partition();
+	const esp_partition_t * target = esp_ota_get_next_update_partition(NULL);
+
+	if(!state.active || source == NULL || target == NULL || size > state.patch_size - state.patch_offset)
+	{
+		return SOL_otaFail(2, state.patch_offset);
+	}
+
+	// Without data, only a copy can be left to finish
+	if(size == 0 && !SOL_otaCopying(&state))
+	{
+		return SOL_otaFail(2, state.patch_offset);
+	}
+
+	// A copy left over from the last chunk comes first
+	if(SOL_otaCopying(&state) && !SOL_otaCopy(&state, source, target))
+	{
+		return SOL_otaFail(3, state.patch_offset);
+	}
+
+	uint32_t pos = 0;
+	while(pos < size && !SOL_otaCopying(&state))
+	{
+		if(state.patch_offset < SOL_OTA_HEADER_SIZE)
+		{
+			uint32_t n = SOL_OTA_HEADER_SIZE - state.patch_offset;
+			if(n > size - pos) {n = size - pos;}
+			memcpy(&state.header[state.patch_offset], &data[pos], n);
+			pos += n;
+			state.patch_offset += n;
+
+			if(state.patch_offset == SOL_OTA_HEADER_SIZE && !SOL_otaCheckHeader(&state, source, target))
+			{
+				return 0;
+			}
+		}
+		else if(state.op == 0)
+		{
+			state.op = data[pos++];
+			state.patch_offset++;
+			state.arg_fill = 0;
+
+			if(state.op != SOL_OTA_OP_COPY && state.op != SOL_OTA_OP_INSERT)
+			{
+				return SOL_otaFail(2, state.patch_offset);
+			}
+		}
+		else if(state.op == SOL_OTA_OP_INSERT && state.arg_fill == 4)
+		{
+			uint32_t n = (state.remaining > size - pos) ? size - pos : state.remaining;
+			if(!SOL_otaTargetWrite(&state, target, &data[pos], n))
+			{
+				return SOL_otaFail(3, state.patch_offset);
+			}
+			pos += n;
+			state.patch_offset += n;
+			state.remaining -= n;
+			if(state.remaining == 0)
+			{
+				state.op = 0;
+			}
+		}
+		else
+		{
+			// Arguments, a source offset and length for a copy or a length for an insert
+			uint8_t args_size = (state.op == SOL_OTA_OP_COPY) ? 8 : 4;
+			state.args[state.arg_fill++] = data[pos++];
+			state.patch_offset++;
+
+			if(state.arg_fill == args_size)
+			{
+				state.remaining = SOL_otaRead32(&state.args[args_size - 4]);
+				if(state.op == SOL_OTA_OP_INSERT)
+				{
+					if(state.remaining == 0) {state.op = 0;}
+				}
+				else
+				{
+					state.copy_source = SOL_otaRead32(&state.args[0]);
+					if(state.copy_source + state.remaining > SOL_otaRead32(&state.header[4]) || state.copy_source + state.remaining < state.copy_source)
+					{
+						return SOL_otaFail(2, state.patch_offset);
+					}
+					if(!SOL_otaCopy(&state, source, target))
+					{
+						return SOL_otaFail(3, state.patch_offset);
+					}
+				}
+			}
+		}
+	}
+
+	ota_state = state;
+	SOL_TRACE_DEBUG(SOL_TRACE_OTA_PROGRESS, state.patch_offset, state.patch_size - state.patch_offset);
+	return 1;
+}
+
+/**
+ * @brief Verifies a completely applied update and makes it the boot image
+ *
+ * @return 1 if the new image boots on the next restart, otherwise 0
+ */
+uint8_t SOL_otaFinish(void)
+{
+	const esp_partition_t * target = esp_ota_get_next_update_partition(NULL);
+	uint32_t target_size = SOL_otaRead32(&ota_state.header[40]);
+
+	if(!SOL_otaComplete() || target == NULL || ota_state.target_written != target_size)
+	{
+		return SOL_otaFail(2, ota_state.patch_offset);
+	}
+
+	uint8_t hash[32];
+	if(!SOL_otaHash(target, target_size, hash) || memcmp(hash, &ota_state.header[44], 32) != 0)
+	{
+		return SOL_otaReject(&ota_state, 4);
+	}
+
+	// Also checks the image is one the bootloader will run
+	if(esp_ota_set_boot_partition(target) != ESP_OK)
+	{
+		return SOL_otaReject(&ota_state, 5);
+	}
+
+	SOL_TRACE_INFO(SOL_TRACE_OTA_READY, ota_state.version, target_size);
+	ota_state.active = 0;
+	return 1;
+}
+
+/**
+ * @brief Abandons the update in progress
+ *
+ */
+void SOL_otaAbort(void)
+{
+	ota_state.active = 0;
+}
+
+/**
+ * @brief Checks if the running firmware is new and waiting to be confirmed
+ *
+ * 	Only ever true with a bootloader built with rollback, see SOL_otaConfirm
+ *
+ * @return 1 if the bootloader rolls back unless the firmware is confirmed this wake, otherwise 0
+ */
+uint8_t SOL_otaUnconfirmed(void)
+{
+	if(ota_unconfirmed < 0)
+	{
+		esp_ota_img_states_t state;
+		const esp_partition_t * running = esp_ota_get_running_partition();
+		ota_unconfirmed = running != NULL && esp_ota_get_state_partition(running, &state) == ESP_OK && state == ESP_OTA_IMG_PENDING_VERIFY;
+	}
+	return ota_unconfirmed;
+}
+
+/**
+ * @brief Confirms the running firmware works, once it reached the server
+ *
+ * 	A new image that never reaches the server is rolled back by SOL_otaRollback at the end of
+ * 	its first wake, so a bad release leaves units on the firmware they ran before instead of out
+ * 	of reach.
+ *
+ */
+void SOL_otaConfirm(void)
+{
+	if(SOL_otaUnconfirmed() && esp_ota_mark_app_valid_cancel_rollback() == ESP_OK)
+	{
+		ota_unconfirmed = 0;
+		SOL_TRACE_INFO(SOL_TRACE_OTA_CONFIRMED, SOL_FIRMWARE_VERSION, 0);
+	}
+}
+
+/**
+ * @brief Rolls back to the previous firmware if the running firmware was not confirmed this wake
+ *
+ * 	Call it instead of going into deep sleep. The bootloader would roll back on the next wake too,
+ * 	but a deep sleep wake keeps RTC memory, so the previous firmware would start with this
+ * 	firmware's RTC state. Rolling back is a software reset, which loads RTC memory afresh.
+ *
+ */
+void SOL_otaRollback(void)
+{
+	if(SOL_otaUnconfirmed())
+	{
+		esp_ota_mark_app_invalid_rollback_and_reboot();
+
+		// Only returns if there is no image to go back to, a reset still loads RTC memory afresh
+		esp_restart();
+	}
+}
@@ -0,0 +1,158 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_ota.h
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Firmware updates for SOL_V2, downloaded as a delta against the running image
+ *
+ * 	The server offers an update in an upload response, as {"ota":{"version":V,"size":S}}. The delta,
+ * 	built by tools/sol_ota_server.py, is then fetched a few chunks per upload session and applied
+ * 	straight into the spare app partition as it arrives. Progress is kept through deep sleep, so a
+ * 	download spreads over as many sessions as it needs. The new image is only booted once the whole
+ * 	delta is applied and its SHA-256 matches. Offers of an older version, or of an update that
+ * 	already failed its checks, are ignored.
+ *
+ * 	The bootloader must be built with CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE in sdkconfig, which the
+ * 	prebuilt Arduino bootloaders are not. Then a new image runs as pending verification, and is only
+ * 	kept once SOL_otaConfirm finds it reached the server. Otherwise SOL_otaRollback resets into the
+ * 	previous image at the end of the wake, rather than leaving a unit running a bad release out of reach.
+ */
+
+
+#ifndef SOL_ota_h
+#define SOL_ota_h
+
+#include <Arduino.h>
+
+#define SOL_OTA_MAGIC						"SOLD"
+#define SOL_OTA_HEADER_SIZE					76					// Magic, source size and SHA-256, target size and SHA-256
+#define SOL_OTA_OP_COPY						0x01				// Source offset and length, copies from the running image
+#define SOL_OTA_OP_INSERT					0x02				// Length and bytes, bytes not in the running image
+
+/**
+ * @brief Starts or continues an update offered in a server response
+ *
+ * 	An offer of the update already in progress continues it, any other newer version restarts the
+ * 	download. Offers of an update that was rejected are ignored until power is lost.
+ *
+ * @param response The server response
+ *
+ */
+void SOL_otaOffer(const String & response);
+
+/**
+ * @brief Checks if an update is being downloaded
+ *
+ * @return 1 if an update is in progress, otherwise 0
+ */
+uint8_t SOL_otaActive(void);
+
+/**
+ * @brief Gets the firmware version being downloaded
+ *
+ * @return The version
+ */
+uint32_t SOL_otaVersion(void);
+
+/**
+ * @brief Gets the offset in the delta to download next
+ *
+ * @return The offset in bytes
+ */
+uint32_t SOL_otaOffset(void);
+
+/**
+ * @brief Gets the number of delta bytes still to download
+ *
+ * @return The number of bytes
+ */
+uint32_t SOL_otaRemaining(void);
+
+/**
+ * @brief Checks if the whole delta has been applied
+ *
+ * @return 1 if the update is ready for SOL_otaFinish, otherwise 0
+ */
+uint8_t SOL_otaComplete(void);
+
+/**
+ * @brief Applies the next chunk of the delta
+ *
+ * 	Progress is only kept once the chunk is applied, so a chunk cut short by a reset is applied
+ * 	again from its start. Flash that was already written is written again with the same bytes,
+ * 	which NOR flash allows. Stops early when the phase runs out of time, SOL_otaOffset then
+ * 	gives where to continue. Call with no data to finish a copy once the delta is downloaded.
+ *
+ * @param data Pointer to the chunk, starting at SOL_otaOffset
+ * @param size The number of bytes
+ *
+ * @return 1 if the chunk was applied, 0 if the update failed and was abandoned
+ */
+uint8_t SOL_otaWrite(const uint8_t * data, uint32_t size);
+
+/**
+ * @brief Verifies a completely applied update and makes it the boot image
+ *
+ * @return 1 if the new image boots on the next restart, otherwise 0
+ */
+uint8_t SOL_otaFinish(void);
+
+/**
+ * @brief Abandons the update in progress
+ *
+ */
+void SOL_otaAbort(void);
+
+/**
+ * @brief Checks if the running firmware is new and waiting to be confirmed
+ *
+ * 	Only ever true with a bootloader built with rollback, see SOL_otaConfirm
+ *
+ * @return 1 if the bootloader rolls back unless the firmware is confirmed this wake, otherwise 0
+ */
+uint8_t SOL_otaUnconfirmed(void);
+
+/**
+ * @brief Confirms the running firmware works, once it reached the server
+ *
+ * 	A new image that never reaches the server is rolled back by SOL_otaRollback at the end of
+ * 	its first wake, so a bad release leaves units on the firmware they ran before instead of out
+ * 	of reach.
+ *
+ */
+void SOL_otaConfirm(void);
+
+/**
+ * @brief Rolls back to the previous firmware if the running firmware was not confirmed this wake
+ *
+ * 	Call it instead of going into deep sleep. The bootloader would roll back on the next wake too,
+ * 	but a deep sleep wake keeps RTC memory, so the previous firmware would start with this
+ * 	firmware's RTC state. Rolling back is a software reset, which loads RTC memory afresh.
+ *
+ */
+void SOL_otaRollback(void);
+
+#endif
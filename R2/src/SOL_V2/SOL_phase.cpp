@@ -0,0 +1,383 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_phase.cpp
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Wake cycle phase tracking for SOL_V2, including per phase CPU frequency and profiling
+ */
+
+#include <Arduino.h>
+#include "sdkconfig.h"
+#include "esp_timer.h"
+
+#ifdef CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+
+#include "SOL_V2.h"
+#include "SOL_phase.h"
+#include "SOL_trace.h"
+
+static const uint16_t phase_cpu_mhz[SOL_PHASE_COUNT] = {
+	CPU_FREQ_MHZ_BOOT,
+	CPU_FREQ_MHZ_CREDENTIALS,
+	CPU_FREQ_MHZ_SWEEP,
+	CPU_FREQ_MHZ_STORAGE,
+	CPU_FREQ_MHZ_CONNECT,
+	CPU_FREQ_MHZ_UPLOAD,
+	CPU_FREQ_MHZ_NTP,
+	CPU_FREQ_MHZ_SLEEP,
+	CPU_FREQ_MHZ_OTA
+};
+
+static const uint32_t phase_deadline_ms[SOL_PHASE_COUNT] = {
+	PHASE_DEADLINE_MS_BOOT,
+	PHASE_DEADLINE_MS_CREDENTIALS,
+	PHASE_DEADLINE_MS_SWEEP,
+	PHASE_DEADLINE_MS_STORAGE,
+	PHASE_DEADLINE_MS_CONNECT,
+	PHASE_DEADLINE_MS_UPLOAD,
+	PHASE_DEADLINE_MS_NTP,
+	PHASE_DEADLINE_MS_SLEEP,
+	PHASE_DEADLINE_MS_OTA
+};
+
+// The hard budget must never cut off a phase that is still within its own deadline
+static_assert(PHASE_DEADLINE_MS_BOOT + PHASE_DEADLINE_MS_CREDENTIALS
+	+ 2 * (PHASE_DEADLINE_MS_SWEEP + PHASE_DEADLINE_MS_STORAGE)
+	+ PHASE_DEADLINE_MS_CONNECT + PHASE_DEADLINE_MS_UPLOAD + PHASE_DEADLINE_MS_OTA
+	+ PHASE_DEADLINE_MS_NTP + PHASE_DEADLINE_MS_SLEEP + WAKE_BUDGET_MARGIN_MS <= WAKE_BUDGET_MS,
+	"Phase deadlines do not fit in the wake budget");
+
+static const char * phase_names[SOL_PHASE_COUNT] = {
+	"boot",
+	"credentials",
+	"sweep",
+	"storage",
+	"connect",
+	"upload",
+	"ntp",
+	"sleep",
+	"ota"
+};
+
+// Per phase statistics across wakes, kept through deep sleep
+RTC_DATA_ATTR SOL_phase_profile_t phase_profile[SOL_PHASE_COUNT];
+
+static SOL_phase_t current_phase = SOL_PHASE_BOOT;
+static uint32_t phase_start_us = 0;
+static uint32_t wake_phase_us[SOL_PHASE_COUNT];
+static uint16_t wake_phase_seen = 0;
+static uint8_t phase_overrun_counted = 0;
+
+static esp_timer_handle_t budget_timer = NULL;
+static void (*budget_on_overrun)(void) = NULL;
+
+#ifdef CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t cpu_max_lock;
+static uint8_t cpu_max_lock_held = 0;
+#endif
+
+/**
+ * @brief Sets the CPU clock for a phase
+ *
+ * 	With power management enabled in ESP-IDF, the phase frequency becomes the DFS maximum
+ * 	and is only held while a CPU_FREQ_MAX lock is taken, so other drivers still get their locks honored.
+ * 	Without it, the clock is switched directly.
+ *
+ * @param mhz The CPU frequency in MHz
+ *
+ */
+static void SOL_applyCpuFrequency(uint16_t mhz)
+{
+	#if defined(SOL_CPU_SCALING) && defined(CONFIG_PM_ENABLE)
+	esp_pm_config_esp32_t pm_config;
+	pm_config.max_freq_mhz = (mhz > CPU_FREQ_MHZ_MIN) ? mhz : CPU_FREQ_MHZ_MIN;
+	pm_config.min_freq_mhz = CPU_FREQ_MHZ_MIN;
+	pm_config.light_sleep_enable = false;
+	esp_pm_configure(&pm_config);
+
+	if(mhz > CPU_FREQ_MHZ_MIN && !cpu_max_lock_held)
+	{
+		esp_pm_lock_acquire(cpu_max_lock);
+		cpu_max_lock_held = 1;
+	}
+	else if(mhz <= CPU_FREQ_MHZ_MIN && cpu_max_lock_held)
+	{
+		esp_pm_lock_release(cpu_max_lock);
+		cpu_max_lock_held = 0;
+	}
+	#elif defined(SOL_CPU_SCALING)
+	if(getCpuFrequencyMhz() != mhz)
+	{
+		setCpuFrequencyMhz(mhz);
+	}
+	#endif
+}
+
+/**
+ * @brief Prepares phase tracking, must be called first thing on wakeup
+ *
+ */
+void SOL_phaseInit(void)
+{
+	#ifdef CONFIG_PM_ENABLE
+	esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "SOL", &cpu_max_lock);
+	#endif
+
+	// Boot phase covers everything since the application started
+	current_phase = SOL_PHASE_BOOT;
+	phase_start_us = 0;
+	phase_overrun_counted = 0;
+
+	for(uint8_t i = 0; i < SOL_PHASE_COUNT; i++)
+	{
+		wake_phase_us[i] = 0;
+	}
+	wake_phase_seen = 0;
+
+	SOL_applyCpuFrequency(phase_cpu_mhz[SOL_PHASE_BOOT]);
+}
+
+/**
+ * @brief Ends the current phase and starts a new one, adjusting the CPU frequency for it
+ *
+ * @param phase The phase being entered
+ *
+ */
+void SOL_enterPhase(SOL_phase_t phase)
+{
+	uint32_t now_us = micros();
+
+	SOL_TRACE_DEBUG(SOL_TRACE_PHASE, current_phase | (getCpuFrequencyMhz() << 8), now_us - phase_start_us);
+
+	// A phase can be entered more than once per wake, its time is summed
+	wake_phase_us[current_phase] += now_us - phase_start_us;
+	wake_phase_seen |= (1 << current_phase);
+
+	current_phase = phase;
+	phase_start_us = now_us;
+	phase_overrun_counted = 0;
+
+	SOL_applyCpuFrequency(phase_cpu_mhz[phase]);
+}
+
+/**
+ * @brief Gets the phase currently running
+ *
+ * @return The current phase
+ *
+ */
+SOL_phase_t SOL_currentPhase(void)
+{
+	return current_phase;
+}
+
+/**
+ * @brief Gets the time left before the current phase passes its deadline
+ *
+ * @return The time left in ms, 0 once the deadline has passed
+ *
+ */
+uint32_t SOL_phaseRemainingMs(void)
+{
+	uint32_t elapsed_ms = (micros() - phase_start_us) / 1000;
+	uint32_t deadline_ms = phase_deadline_ms[current_phase];
+
+	return (elapsed_ms >= deadline_ms) ? 0 : deadline_ms - elapsed_ms;
+}
+
+/**
+ * @brief Checks if the current phase has passed its deadline, counting the overrun the first time
+ *
+ * @return 1 if the deadline has passed and the phase should stop, otherwise 0
+ *
+ */
+uint8_t SOL_phaseExpired(void)
+{
+	if(SOL_phaseRemainingMs() > 0)
+	{
+		return 0;
+	}
+
+	if(!phase_overrun_counted)
+	{
+		phase_overrun_counted = 1;
+		phase_profile[current_phase].overruns++;
+		SOL_TRACE_WARN(SOL_TRACE_PHASE_OVERRUN, current_phase, (micros() - phase_start_us) / 1000);
+	}
+
+	return 1;
+}
+
+/**
+ * @brief Ends the wake from the esp_timer task once the wake budget is spent
+ *
+ * @param arg Unused
+ *
+ */
+static void SOL_budgetExpired(void * arg)
+{
+	if(!phase_overrun_counted)
+	{
+		phase_overrun_counted = 1;
+		phase_profile[current_phase].overruns++;
+	}
+	SOL_TRACE_ERROR(SOL_TRACE_WAKE_BUDGET, current_phase, millis());
+
+	budget_on_overrun();
+}
+
+/**
+ * @brief Starts the hard limit for the whole wake
+ *
+ * 	Once WAKE_BUDGET_MS passes, the overrun is counted against the current phase and on_overrun
+ * 	is called from the esp_timer task. It must put the ESP32 to sleep without touching peripherals,
+ * 	since the main task may be stuck in a driver.
+ *
+ * @param on_overrun The function that ends the wake
+ *
+ */
+void SOL_phaseStartBudget(void (*on_overrun)(void))
+{
+	budget_on_overrun = on_overrun;
+
+	if(budget_timer == NULL)
+	{
+		esp_timer_create_args_t args;
+		args.callback = SOL_budgetExpired;
+		args.arg = NULL;
+		args.dispatch_method = ESP_TIMER_TASK;
+		args.name = "SOL_budget";
+		if(esp_timer_create(&args, &budget_timer) != ESP_OK)
+		{
+			budget_timer = NULL;
+			return;
+		}
+	}
+
+	// The budget counts from boot, like the boot phase
+	uint32_t elapsed_ms = millis();
+	uint32_t left_ms = (elapsed_ms < WAKE_BUDGET_MS) ? WAKE_BUDGET_MS - elapsed_ms : 1;
+	esp_timer_start_once(budget_timer, (uint64_t) left_ms * 1000);
+}
+
+/**
+ * @brief Stops the hard limit for the whole wake, for wakes that legitimately run long
+ *
+ */
+void SOL_phaseStopBudget(void)
+{
+	if(budget_timer != NULL)
+	{
+		esp_timer_stop(budget_timer);
+	}
+}
+
+/**
+ * @brief Closes out the current phase and adds this wake's phase times to the profile
+ *
+ * 	Must be called right before entering deep sleep
+ */
+void SOL_phaseFinish(void)
+{
+	uint32_t now_us = micros();
+	wake_phase_us[current_phase] += now_us - phase_start_us;
+	wake_phase_seen |= (1 << current_phase);
+	phase_start_us = now_us;
+
+	for(uint8_t i = 0; i < SOL_PHASE_COUNT; i++)
+	{
+		if(!(wake_phase_seen & (1 << i)))
+		{
+			continue;
+		}
+
+		SOL_phase_profile_t * profile = &phase_profile[i];
+		uint32_t t = wake_phase_us[i];
+
+		if(profile->count == 0 || t < profile->min_us) {profile->min_us = t;}
+		if(profile->count == 0 || t > profile->max_us) {profile->max_us = t;}
+		profile->total_us += t;
+		profile->count++;
+	}
+
+	wake_phase_seen = 0;
+}
+
+/**
+ * @brief Gets the profile of a phase
+ *
+ * @param phase The phase of interest
+ *
+ * @return Pointer to the phase profile
+ *
+ */
+const SOL_phase_profile_t * SOL_getPhaseProfile(SOL_phase_t phase)
+{
+	return &phase_profile[phase];
+}
+
+/**
+ * @brief Formats the phase profile as JSON for upload
+ *
+ * 	Each phase is reported as [count, min us, max us, mean us, deadline overruns]
+ *
+ * @return The JSON object
+ *
+ */
+String SOL_profileToJSON(void)
+{
+	String json = "{";
+	for(uint8_t i = 0; i < SOL_PHASE_COUNT; i++)
+	{
+		const SOL_phase_profile_t * profile = &phase_profile[i];
+		uint32_t mean_us = profile->count ? (uint32_t) (profile->total_us / profile->count) : 0;
+
+		if(i > 0) {json += ",";}
+		json += String("\"") + phase_names[i] + "\":[" + profile->count + "," + profile->min_us + ","
+			+ profile->max_us + "," + mean_us + "," + profile->overruns + "]";
+	}
+	json += "}";
+
+	return json;
+}
+
+/**
+ * @brief Clears the phase profile, starting a new reporting interval
+ *
+ */
+void SOL_profileReset(void)
+{
+	for(uint8_t i = 0; i < SOL_PHASE_COUNT; i++)
+	{
+		phase_profile[i].count = 0;
+		phase_profile[i].min_us = 0;
+		phase_profile[i].max_us = 0;
+		phase_profile[i].total_us = 0;
+		phase_profile[i].overruns = 0;
+	}
+}
@@ -0,0 +1,156 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_phase.h
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Wake cycle phase tracking for SOL_V2, including per phase CPU frequency and profiling
+ */
+
+
+#ifndef SOL_phase_h
+#define SOL_phase_h
+
+#include <Arduino.h>
+
+/**
+ * @brief Phases of a single wake cycle
+ */
+typedef enum SOL_phase_t
+{
+	SOL_PHASE_BOOT = 0,
+	SOL_PHASE_CREDENTIALS,
+	SOL_PHASE_SWEEP,
+	SOL_PHASE_STORAGE,
+	SOL_PHASE_CONNECT,
+	SOL_PHASE_UPLOAD,
+	SOL_PHASE_NTP,
+	SOL_PHASE_SLEEP,
+	SOL_PHASE_OTA,				// Added after the others, so their profile indices stay the same
+	SOL_PHASE_COUNT
+} SOL_phase_t;
+
+/**
+ * @brief Timing statistics of one phase across wakes
+ */
+typedef struct SOL_phase_profile_t
+{
+	uint32_t count;
+	uint32_t min_us;
+	uint32_t max_us;
+	uint64_t total_us;
+	uint32_t overruns;		// Times the phase passed its deadline
+} SOL_phase_profile_t;
+
+/**
+ * @brief Prepares phase tracking, must be called first thing on wakeup
+ *
+ */
+void SOL_phaseInit(void);
+
+/**
+ * @brief Ends the current phase and starts a new one, adjusting the CPU frequency for it
+ *
+ * @param phase The phase being entered
+ *
+ */
+void SOL_enterPhase(SOL_phase_t phase);
+
+/**
+ * @brief Gets the phase currently running
+ *
+ * @return The current phase
+ *
+ */
+SOL_phase_t SOL_currentPhase(void);
+
+/**
+ * @brief Gets the time left before the current phase passes its deadline
+ *
+ * @return The time left in ms, 0 once the deadline has passed
+ *
+ */
+uint32_t SOL_phaseRemainingMs(void);
+
+/**
+ * @brief Checks if the current phase has passed its deadline, counting the overrun the first time
+ *
+ * @return 1 if the deadline has passed and the phase should stop, otherwise 0
+ *
+ */
+uint8_t SOL_phaseExpired(void);
+
+/**
+ * @brief Starts the hard limit for the whole wake
+ *
+ * 	Once WAKE_BUDGET_MS passes, the overrun is counted against the current phase and on_overrun
+ * 	is called from the esp_timer task. It must put the ESP32 to sleep without touching peripherals,
+ * 	since the main task may be stuck in a driver.
+ *
+ * @param on_overrun The function that ends the wake
+ *
+ */
+void SOL_phaseStartBudget(void (*on_overrun)(void));
+
+/**
+ * @brief Stops the hard limit for the whole wake, for wakes that legitimately run long
+ *
+ */
+void SOL_phaseStopBudget(void);
+
+/**
+ * @brief Closes out the current phase and adds this wake's phase times to the profile
+ *
+ * 	Must be called right before entering deep sleep
+ */
+void SOL_phaseFinish(void);
+
+/**
+ * @brief Gets the profile of a phase
+ *
+ * @param phase The phase of interest
+ *
+ * @return Pointer to the phase profile
+ *
+ */
+const SOL_phase_profile_t * SOL_getPhaseProfile(SOL_phase_t phase);
+
+/**
+ * @brief Formats the phase profile as JSON for upload
+ *
+ * 	Each phase is reported as [count, min us, max us, mean us, deadline overruns]
+ *
+ * @return The JSON object
+ *
+ */
+String SOL_profileToJSON(void);
+
+/**
+ * @brief Clears the phase profile, starting a new reporting interval
+ *
+ */
+void SOL_profileReset(void);
+
+#endif
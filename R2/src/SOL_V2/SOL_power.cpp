@@ -0,0 +1,136 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_power.cpp
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Battery driven power modes for SOL_V2, trading data for survival as the battery runs down
+ */
+
+#include <Arduino.h>
+
+#include "SOL_V2.h"
+#include "SOL_power.h"
+#include "SOL_trace.h"
+
+#define POWER_MODE_COUNT		4
+
+// Battery voltage below which each mode is entered, normal is never entered by falling
+static const float power_enter_v[POWER_MODE_COUNT] = {
+	0.0,
+	POWER_REDUCED_BATT_V,
+	POWER_LOG_ONLY_BATT_V,
+	POWER_SURVIVAL_BATT_V
+};
+
+// Kept through deep sleep
+RTC_DATA_ATTR uint8_t power_mode = SOL_POWER_NORMAL;
+
+/**
+ * @brief Updates the power mode from the battery, kept through deep sleep
+ *
+ * 	Drops straight to the mode the battery voltage calls for, but only rises one mode per wake
+ * 	and only once the voltage is POWER_HYSTERESIS_V above the current mode's threshold. While
+ * 	charging the battery reads high, so rising needs another POWER_CHARGING_RISE_V.
+ *
+ * @param batt_v The battery voltage
+ * @param charging 1 if the battery is being charged, otherwise 0
+ *
+ * @return The power mode
+ */
+SOL_power_mode_t SOL_powerUpdate(float batt_v, uint8_t charging)
+{
+	uint8_t mode = power_mode;
+
+	uint8_t target = SOL_POWER_NORMAL;
+	for(uint8_t m = SOL_POWER_REDUCED; m < POWER_MODE_COUNT; m++)
+	{
+		if(batt_v < power_enter_v[m])
+		{
+			target = m;
+		}
+	}
+
+	if(target > mode)
+	{
+		mode = target;
+	}
+	else if(mode > SOL_POWER_NORMAL)
+	{
+		float exit_v = power_enter_v[mode] + POWER_HYSTERESIS_V + (charging ? POWER_CHARGING_RISE_V : 0.0);
+		if(batt_v >= exit_v)
+		{
+			mode--;
+		}
+	}
+
+	if(mode != power_mode)
+	{
+		SOL_TRACE_WARN(SOL_TRACE_POWER_MODE, mode, SOL_traceFloat(batt_v));
+		power_mode = mode;
+	}
+
+	return (SOL_power_mode_t) power_mode;
+}
+
+/**
+ * @brief Gets the current power mode
+ *
+ * @return The power mode
+ */
+SOL_power_mode_t SOL_powerMode(void)
+{
+	return (SOL_power_mode_t) power_mode;
+}
+
+/**
+ * @brief Lengthens a sleep time for the current power mode
+ *
+ * @param len The sleep time the schedule asked for, seconds
+ *
+ * @return The sleep time to use, seconds
+ */
+uint32_t SOL_powerAdjustSleep(uint32_t len)
+{
+	switch(power_mode)
+	{
+		case SOL_POWER_REDUCED:
+			len *= POWER_REDUCED_SLEEP_FACTOR;
+			break;
+		case SOL_POWER_LOG_ONLY:
+			len *= POWER_LOG_ONLY_SLEEP_FACTOR;
+			break;
+		case SOL_POWER_SURVIVAL:
+			if(len < POWER_SURVIVAL_SLEEP_SECONDS)
+			{
+				len = POWER_SURVIVAL_SLEEP_SECONDS;
+			}
+			break;
+		default:
+			break;
+	}
+
+	return (len > SCHEDULE_MAX_SLEEP_SECONDS) ? SCHEDULE_MAX_SLEEP_SECONDS : len;
+}
@@ -0,0 +1,79 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_power.h
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Battery driven power modes for SOL_V2, trading data for survival as the battery runs down
+ */
+
+
+#ifndef SOL_power_h
+#define SOL_power_h
+
+#include <Arduino.h>
+
+/**
+ * @brief Power modes, from most to least capable
+ */
+typedef enum SOL_power_mode_t
+{
+	SOL_POWER_NORMAL = 0,			// Full operation
+	SOL_POWER_REDUCED,				// Sparse sweep without dense fallback or curves, longer sleeps
+	SOL_POWER_LOG_ONLY,				// As reduced with even longer sleeps, and no radio
+	SOL_POWER_SURVIVAL				// No sweep or radio, only wakes to check the battery
+} SOL_power_mode_t;
+
+/**
+ * @brief Updates the power mode from the battery, kept through deep sleep
+ *
+ * 	Drops straight to the mode the battery voltage calls for, but only rises one mode per wake
+ * 	and only once the voltage is POWER_HYSTERESIS_V above the current mode's threshold. While
+ * 	charging the battery reads high, so rising needs another POWER_CHARGING_RISE_V.
+ *
+ * @param batt_v The battery voltage
+ * @param charging 1 if the battery is being charged, otherwise 0
+ *
+ * @return The power mode
+ */
+SOL_power_mode_t SOL_powerUpdate(float batt_v, uint8_t charging);
+
+/**
+ * @brief Gets the current power mode
+ *
+ * @return The power mode
+ */
+SOL_power_mode_t SOL_powerMode(void);
+
+/**
+ * @brief Lengthens a sleep time for the current power mode
+ *
+ * @param len The sleep time the schedule asked for, seconds
+ *
+ * @return The sleep time to use, seconds
+ */
+uint32_t SOL_powerAdjustSleep(uint32_t len);
+
+#endif
@@ -0,0 +1,489 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_schedule.cpp
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Sampling schedule for SOL_V2 based on sunrise and sunset at the site
+ */
+
+#include <Arduino.h>
+
+#include "SOL_V2.h"
+#include "SOL_schedule.h"
+#include "SOL_config.h"
+#include "SOL_trace.h"
+
+#define SITE_NOT_LOADED			0
+#define SITE_UNKNOWN			1
+#define SITE_KNOWN				2
+
+#define J2000_UNIX_TIME			946728000UL			// January 1st, 2000, 12:00 UTC
+#define SECONDS_PER_DAY			86400UL
+#define DEG_TO_RAD_D			(M_PI / 180.0)
+
+typedef enum SOL_upload_reason_t
+{
+	UPLOAD_REASON_DEFER = 0,
+	UPLOAD_REASON_LOG_FULL,
+	UPLOAD_REASON_OVERDUE,
+	UPLOAD_REASON_CHARGING
+} SOL_upload_reason_t;
+
+// Site location cached through deep sleep, so night wakes need no EEPROM access
+RTC_DATA_ATTR uint8_t site_state = SITE_NOT_LOADED;
+RTC_DATA_ATTR float site_latitude = 0.0;
+RTC_DATA_ATTR float site_longitude = 0.0;
+
+// Recent peak powers and burst state, kept through deep sleep
+RTC_DATA_ATTR float power_history_mW[BURST_HISTORY_LENGTH];
+RTC_DATA_ATTR uint8_t power_history_count = 0;
+RTC_DATA_ATTR uint8_t power_history_next = 0;
+RTC_DATA_ATTR uint8_t burst_remaining = 0;
+
+// WiFi connection backoff, kept through deep sleep
+RTC_DATA_ATTR uint8_t wifi_failures = 0;
+RTC_DATA_ATTR uint32_t wifi_retry_time = 0;
+
+/**
+ * @brief Stores the site location in EEPROM
+ *
+ * @param latitude The latitude in degrees, north positive
+ * @param longitude The longitude in degrees, east positive
+ *
+ * @return 1 if the location is valid and was stored, otherwise 0
+ */
+uint8_t SOL_setSiteLocation(float latitude, float longitude)
+{
+	if(isnan(latitude) || isnan(longitude) || fabs(latitude) > 90.0 || fabs(longitude) > 180.0)
+	{
+		return 0;
+	}
+
+	SOL_writeEEPROMNByte(EEPROM_ADDRESS_SITE_LATITUDE, (uint8_t *) &latitude, sizeof(float));
+	SOL_writeEEPROMNByte(EEPROM_ADDRESS_SITE_LONGITUDE, (uint8_t *) &longitude, sizeof(float));
+	SOL_writeEEPROMByte(EEPROM_ADDRESS_SITE_AVAILABLE, (uint8_t) 1);
+
+	site_latitude = latitude;
+	site_longitude = longitude;
+	site_state = SITE_KNOWN;
+
+	return 1;
+}
+
+/**
+ * @brief Checks if the site location is known, loading it from EEPROM on first use
+ *
+ * @return 1 if the location is known, otherwise 0
+ */
+uint8_t SOL_hasSiteLocation(void)
+{
+	if(site_state == SITE_NOT_LOADED)
+	{
+		site_state = SITE_UNKNOWN;
+		if(SOL_readEEPROMByte(EEPROM_ADDRESS_SITE_AVAILABLE) == 1)
+		{
+			SOL_readEEPROMNByte(EEPROM_ADDRESS_SITE_LATITUDE, (uint8_t *) &site_latitude, sizeof(float));
+			SOL_readEEPROMNByte(EEPROM_ADDRESS_SITE_LONGITUDE, (uint8_t *) &site_longitude, sizeof(float));
+			site_state = SITE_KNOWN;
+		}
+	}
+
+	return site_state == SITE_KNOWN;
+}
+
+/**
+ * @brief Gets how far local mean solar time at the site is ahead of UTC
+ *
+ * @return The offset in seconds, 0 if the site location is unknown
+ */
+int32_t SOL_siteSolarOffset(void)
+{
+	if(!SOL_hasSiteLocation())
+	{
+		return 0;
+	}
+
+	// The sun moves 15 degrees of longitude per hour
+	return (int32_t) (site_longitude * 240.0);
+}
+
+/**
+ * @brief Computes sunrise, solar noon and sunset for the UTC day containing a time
+ *
+ * 	If the sun does not rise or set that day, sunrise and sunset are both set to noon
+ * 	for polar night, or to the start and end of the day for midnight sun
+ *
+ * @param time Seconds since January 1st, 1970
+ * @param latitude The latitude in degrees, north positive
+ * @param longitude The longitude in degrees, east positive
+ *
+ * @return The sun times
+ */
+SOL_sun_times_t SOL_getSunTimes(uint32_t time, float latitude, float longitude)
+{
+	/*
+	*  Sunrise equation, see https://en.wikipedia.org/wiki/Sunrise_equation
+	*
+	*	Accurate to about a minute, plenty for scheduling. Double precision is needed for the day count.
+	*/
+
+	// Days since January 1st, 2000 and mean solar noon at the site
+	double n = floor(((double) time - (J2000_UNIX_TIME - SECONDS_PER_DAY/2)) / SECONDS_PER_DAY);
+	double j_star = n - longitude / 360.0;
+
+	// Solar mean anomaly, equation of center, ecliptic longitude
+	double M = fmod(357.5291 + 0.98560028 * j_star, 360.0);
+	double C = 1.9148 * sin(M * DEG_TO_RAD_D) + 0.02 * sin(2.0 * M * DEG_TO_RAD_D) + 0.0003 * sin(3.0 * M * DEG_TO_RAD_D);
+	double lambda = fmod(M + C + 180.0 + 102.9372, 360.0);
+
+	// Solar transit, days since J2000
+	double transit = j_star + 0.0053 * sin(M * DEG_TO_RAD_D) - 0.0069 * sin(2.0 * lambda * DEG_TO_RAD_D);
+
+	// Declination and hour angle, including refraction and the size of the sun
+	double sin_decl = sin(lambda * DEG_TO_RAD_D) * sin(23.4397 * DEG_TO_RAD_D);
+	double cos_decl = sqrt(1.0 - sin_decl * sin_decl);
+	double cos_hour_angle = (sin(-0.833 * DEG_TO_RAD_D) - sin(latitude * DEG_TO_RAD_D) * sin_decl)
+		/ (cos(latitude * DEG_TO_RAD_D) * cos_decl);
+
+	SOL_sun_times_t sun;
+	sun.noon = (uint32_t) (J2000_UNIX_TIME + transit * SECONDS_PER_DAY);
+
+	if(cos_hour_angle > 1.0)
+	{
+		// Polar night
+		sun.sunrise = sun.noon;
+		sun.sunset = sun.noon;
+	}
+	else if(cos_hour_angle < -1.0)
+	{
+		// Midnight sun
+		sun.sunrise = sun.noon - SECONDS_PER_DAY/2;
+		sun.sunset = sun.noon + SECONDS_PER_DAY/2;
+	}
+	else
+	{
+		uint32_t half_day = (uint32_t) (acos(cos_hour_angle) / (2.0 * M_PI) * SECONDS_PER_DAY);
+		sun.sunrise = sun.noon - half_day;
+		sun.sunset = sun.noon + half_day;
+	}
+
+	return sun;
+}
+
+/**
+ * @brief Finds the daylight period the time is in, or the next one
+ *
+ * 	Looks at the UTC day before and after too, since for sites far from Greenwich
+ * 	the local day does not line up with the UTC day
+ *
+ * @param time Seconds since January 1st, 1970
+ * @param sun Pointer to put the sun times of the daylight period in
+ *
+ * @return 1 if the time is during daylight, otherwise 0
+ */
+static uint8_t SOL_findDaylight(uint32_t time, SOL_sun_times_t * sun)
+{
+	uint8_t found_next = 0;
+
+	for(int8_t day = -1; day <= 1; day++)
+	{
+		SOL_sun_times_t candidate = SOL_getSunTimes(time + day * (int32_t) SECONDS_PER_DAY, site_latitude, site_longitude);
+
+		if(candidate.sunrise <= time && time < candidate.sunset)
+		{
+			*sun = candidate;
+			return 1;
+		}
+
+		if(candidate.sunrise > time && !found_next)
+		{
+			*sun = candidate;
+			found_next = 1;
+		}
+	}
+
+	if(!found_next)
+	{
+		// Polar night, check again in a day
+		sun->sunrise = time + SECONDS_PER_DAY;
+		sun->noon = sun->sunrise;
+		sun->sunset = sun->sunrise;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Checks if the sun is down at the site, using the stored schedule only
+ *
+ * @param time Seconds since January 1st, 1970, or 0 if unknown
+ *
+ * @return 1 if the site location and time are known and the sun is down, otherwise 0
+ */
+uint8_t SOL_scheduleIsNight(uint32_t time)
+{
+	// Only the RTC cache is used, so this is safe before I2C is started
+	if(time == 0 || site_state != SITE_KNOWN)
+	{
+		return 0;
+	}
+
+	SOL_sun_times_t sun;
+	if(SOL_findDaylight(time, &sun))
+	{
+		return 0;
+	}
+
+	// Wake a little before sunrise
+	return (time + SCHEDULE_SUNRISE_MARGIN_SECONDS) < sun.sunrise;
+}
+
+/**
+ * @brief Adds the latest peak power to the schedule, starting a burst of samples if it changed sharply
+ *
+ * 	The new power is compared to the mean of the recent history. A burst lasts BURST_SAMPLE_COUNT
+ * 	samples after the last sharp change, then sampling returns to the base rate.
+ *
+ * @param peak_power_mW The latest peak power
+ *
+ */
+void SOL_scheduleRecordSample(float peak_power_mW)
+{
+	if(power_history_count > 0)
+	{
+		float mean = 0.0;
+		for(uint8_t i = 0; i < power_history_count; i++)
+		{
+			mean += power_history_mW[i];
+		}
+		mean /= power_history_count;
+
+		float reference = (mean > BURST_CHANGE_FLOOR_MW) ? mean : BURST_CHANGE_FLOOR_MW;
+		float change = fabs(peak_power_mW - mean);
+
+		#ifdef SOL_BURST_SAMPLING
+		if(change > BURST_CHANGE_FRACTION * reference)
+		{
+			if(burst_remaining == 0)
+			{
+				SOL_TRACE_INFO(SOL_TRACE_BURST_START, SOL_traceFloat(peak_power_mW), SOL_traceFloat(mean));
+			}
+			burst_remaining = BURST_SAMPLE_COUNT;
+		}
+		else if(burst_remaining > 0)
+		{
+			burst_remaining--;
+		}
+		#endif
+	}
+
+	power_history_mW[power_history_next] = peak_power_mW;
+	power_history_next = (power_history_next + 1) % BURST_HISTORY_LENGTH;
+	if(power_history_count < BURST_HISTORY_LENGTH)
+	{
+		power_history_count++;
+	}
+}
+
+/**
+ * @brief Computes how long to sleep until the next sample
+ *
+ * 	Samples densely around solar noon and in bursts when power is changing sharply,
+ * 	and sleeps until just before sunrise at night
+ *
+ * @param time Seconds since January 1st, 1970, or 0 if unknown
+ *
+ * @return The time to sleep in seconds
+ */
+uint32_t SOL_scheduleNextSleep(uint32_t time)
+{
+	uint32_t sleep_time;
+	SOL_sun_times_t sun;
+
+	if(time == 0 || !SOL_hasSiteLocation())
+	{
+		// Without time or location, keep the fixed interval
+		sleep_time = SOL_config()->sleep_s;
+	}
+	else if(!SOL_findDaylight(time, &sun))
+	{
+		// Night, sleep until just before sunrise
+		uint32_t wake_time = sun.sunrise - SCHEDULE_SUNRISE_MARGIN_SECONDS;
+		sleep_time = (wake_time > time) ? (wake_time - time) : SOL_config()->sleep_s;
+		if(sleep_time > SCHEDULE_MAX_SLEEP_SECONDS)
+		{
+			sleep_time = SCHEDULE_MAX_SLEEP_SECONDS;
+		}
+	}
+	else
+	{
+		// Interpolate from solar noon (0) to sunrise or sunset (1)
+		int32_t from_noon = (int32_t) (time - sun.noon);
+		uint32_t half_day = (from_noon < 0) ? (sun.noon - sun.sunrise) : (sun.sunset - sun.noon);
+		float offset = (half_day > 0) ? fabs((float) from_noon) / (float) half_day : 1.0;
+		if(offset > 1.0) {offset = 1.0;}
+
+		const SOL_config_t * cfg = SOL_config();
+		sleep_time = cfg->sleep_s + (uint32_t) (offset * (cfg->edge_sleep_s - cfg->sleep_s));
+	}
+
+	// Shading events get sampled at a high rate until readings settle
+	if(burst_remaining > 0 && sleep_time > BURST_SLEEP_SECONDS)
+	{
+		sleep_time = BURST_SLEEP_SECONDS;
+	}
+
+	SOL_TRACE_INFO(SOL_TRACE_SCHEDULE, sleep_time, burst_remaining);
+
+	return sleep_time;
+}
+
+/**
+ * @brief Gets the latest peak power added to the schedule
+ *
+ * @return The peak power in mW, 0 if there is none yet
+ */
+float SOL_scheduleLastPower(void)
+{
+	if(power_history_count == 0)
+	{
+		return 0.0;
+	}
+
+	return power_history_mW[(power_history_next + BURST_HISTORY_LENGTH - 1) % BURST_HISTORY_LENGTH];
+}
+
+/**
+ * @brief Decides if stored data should be uploaded now
+ *
+ * 	Uploads midday while the panel is charging the battery, defers on low battery,
+ * 	and uploads regardless when the log is nearly full or data has waited too long
+ *
+ * @param datapoints The number of datapoints waiting
+ * @param minimum The number of datapoints worth uploading
+ * @param capacity The number of datapoints the log can hold
+ * @param batt_v The battery voltage
+ * @param charging 1 if the battery is being charged, otherwise 0
+ * @param time Seconds since January 1st, 1970, or 0 if unknown
+ *
+ * @return 1 if data should be uploaded, otherwise 0
+ */
+uint8_t SOL_scheduleShouldUpload(uint32_t datapoints, uint32_t minimum, uint32_t capacity, float batt_v, uint8_t charging, uint32_t time)
+{
+	SOL_upload_reason_t reason = UPLOAD_REASON_DEFER;
+	uint8_t nearly_full = datapoints >= (uint32_t) (UPLOAD_FULL_FRACTION * capacity);
+
+	if(datapoints < minimum || batt_v < SOL_config()->upload_critical_batt_v)
+	{
+		reason = UPLOAD_REASON_DEFER;
+	}
+	else if(nearly_full)
+	{
+		reason = UPLOAD_REASON_LOG_FULL;
+	}
+	else if(batt_v < SOL_config()->upload_low_batt_v)
+	{
+		reason = UPLOAD_REASON_DEFER;
+	}
+	else if(datapoints >= SOL_config()->max_defer_count)
+	{
+		reason = UPLOAD_REASON_OVERDUE;
+	}
+	else if(charging)
+	{
+		// Midday if the schedule is known, otherwise any time the panel is charging
+		SOL_sun_times_t sun;
+		if(time == 0 || !SOL_hasSiteLocation())
+		{
+			reason = UPLOAD_REASON_CHARGING;
+		}
+		else if(SOL_findDaylight(time, &sun) && (uint32_t) abs((int32_t) (time - sun.noon)) < UPLOAD_MIDDAY_WINDOW_SECONDS)
+		{
+			reason = UPLOAD_REASON_CHARGING;
+		}
+	}
+
+	SOL_TRACE_INFO(SOL_TRACE_UPLOAD_POLICY, reason, SOL_traceFloat(batt_v));
+
+	return reason != UPLOAD_REASON_DEFER;
+}
+
+/**
+ * @brief Checks if a WiFi connection may be attempted, or if it is still backing off after failures
+ *
+ * @param time Seconds from SOL_getRawTime
+ *
+ * @return 1 if a connection may be attempted, otherwise 0
+ */
+uint8_t SOL_scheduleWiFiAllowed(uint32_t time)
+{
+	if(wifi_failures == 0 || time >= wifi_retry_time)
+	{
+		return 1;
+	}
+
+	SOL_TRACE_INFO(SOL_TRACE_WIFI_BACKOFF, wifi_failures, wifi_retry_time - time);
+	return 0;
+}
+
+/**
+ * @brief Records a failed WiFi connection, doubling the wait before the next attempt
+ *
+ * @param time Seconds from SOL_getRawTime
+ *
+ */
+void SOL_scheduleWiFiFailed(uint32_t time)
+{
+	if(wifi_failures < 255)
+	{
+		wifi_failures++;
+	}
+
+	uint32_t wait = WIFI_BACKOFF_MAX_SECONDS;
+	if(wifi_failures <= 16)
+	{
+		wait = (uint32_t) WIFI_BACKOFF_BASE_SECONDS << (wifi_failures - 1);
+	}
+	if(wait > WIFI_BACKOFF_MAX_SECONDS)
+	{
+		wait = WIFI_BACKOFF_MAX_SECONDS;
+	}
+
+	wait += esp_random() % (wait * WIFI_BACKOFF_JITTER_PERCENT / 100 + 1);
+	wifi_retry_time = time + wait;
+
+	SOL_TRACE_WARN(SOL_TRACE_WIFI_BACKOFF, wifi_failures, wait);
+}
+
+/**
+ * @brief Records a WiFi connection, clearing any backoff
+ *
+ */
+void SOL_scheduleWiFiConnected(void)
+{
+	wifi_failures = 0;
+	wifi_retry_time = 0;
+}
@@ -0,0 +1,165 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_schedule.h
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Sampling schedule for SOL_V2 based on sunrise and sunset at the site
+ */
+
+
+#ifndef SOL_schedule_h
+#define SOL_schedule_h
+
+#include <Arduino.h>
+
+/**
+ * @brief Sun times for one day, seconds since January 1st, 1970
+ */
+typedef struct SOL_sun_times_t
+{
+	uint32_t sunrise;
+	uint32_t noon;
+	uint32_t sunset;
+} SOL_sun_times_t;
+
+/**
+ * @brief Stores the site location in EEPROM
+ *
+ * @param latitude The latitude in degrees, north positive
+ * @param longitude The longitude in degrees, east positive
+ *
+ * @return 1 if the location is valid and was stored, otherwise 0
+ */
+uint8_t SOL_setSiteLocation(float latitude, float longitude);
+
+/**
+ * @brief Checks if the site location is known, loading it from EEPROM on first use
+ *
+ * @return 1 if the location is known, otherwise 0
+ */
+uint8_t SOL_hasSiteLocation(void);
+
+/**
+ * @brief Gets how far local mean solar time at the site is ahead of UTC
+ *
+ * @return The offset in seconds, 0 if the site location is unknown
+ */
+int32_t SOL_siteSolarOffset(void);
+
+/**
+ * @brief Computes sunrise, solar noon and sunset for the UTC day containing a time
+ *
+ * 	If the sun does not rise or set that day, sunrise and sunset are both set to noon
+ * 	for polar night, or to the start and end of the day for midnight sun
+ *
+ * @param time Seconds since January 1st, 1970
+ * @param latitude The latitude in degrees, north positive
+ * @param longitude The longitude in degrees, east positive
+ *
+ * @return The sun times
+ */
+SOL_sun_times_t SOL_getSunTimes(uint32_t time, float latitude, float longitude);
+
+/**
+ * @brief Checks if the sun is down at the site, using the stored schedule only
+ *
+ * @param time Seconds since January 1st, 1970, or 0 if unknown
+ *
+ * @return 1 if the site location and time are known and the sun is down, otherwise 0
+ */
+uint8_t SOL_scheduleIsNight(uint32_t time);
+
+/**
+ * @brief Adds the latest peak power to the schedule, starting a burst of samples if it changed sharply
+ *
+ * 	The new power is compared to the mean of the recent history. A burst lasts BURST_SAMPLE_COUNT
+ * 	samples after the last sharp change, then sampling returns to the base rate.
+ *
+ * @param peak_power_mW The latest peak power
+ *
+ */
+void SOL_scheduleRecordSample(float peak_power_mW);
+
+/**
+ * @brief Computes how long to sleep until the next sample
+ *
+ * 	Samples densely around solar noon and in bursts when power is changing sharply,
+ * 	and sleeps until just before sunrise at night
+ *
+ * @param time Seconds since January 1st, 1970, or 0 if unknown
+ *
+ * @return The time to sleep in seconds
+ */
+uint32_t SOL_scheduleNextSleep(uint32_t time);
+
+/**
+ * @brief Gets the latest peak power added to the schedule
+ *
+ * @return The peak power in mW, 0 if there is none yet
+ */
+float SOL_scheduleLastPower(void);
+
+/**
+ * @brief Decides if stored data should be uploaded now
+ *
+ * 	Uploads midday while the panel is charging the battery, defers on low battery,
+ * 	and uploads regardless when the log is nearly full or data has waited too long
+ *
+ * @param datapoints The number of datapoints waiting
+ * @param minimum The number of datapoints worth uploading
+ * @param capacity The number of datapoints the log can hold
+ * @param batt_v The battery voltage
+ * @param charging 1 if the battery is being charged, otherwise 0
+ * @param time Seconds since January 1st, 1970, or 0 if unknown
+ *
+ * @return 1 if data should be uploaded, otherwise 0
+ */
+uint8_t SOL_scheduleShouldUpload(uint32_t datapoints, uint32_t minimum, uint32_t capacity, float batt_v, uint8_t charging, uint32_t time);
+
+/**
+ * @brief Checks if a WiFi connection may be attempted, or if it is still backing off after failures
+ *
+ * @param time Seconds from SOL_getRawTime
+ *
+ * @return 1 if a connection may be attempted, otherwise 0
+ */
+uint8_t SOL_scheduleWiFiAllowed(uint32_t time);
+
+/**
+ * @brief Records a failed WiFi connection, doubling the wait before the next attempt
+ *
+ * @param time Seconds from SOL_getRawTime
+ *
+ */
+void SOL_scheduleWiFiFailed(uint32_t time);
+
+/**
+ * @brief Records a WiFi connection, clearing any backoff
+ *
+ */
+void SOL_scheduleWiFiConnected(void);
+
+#endif
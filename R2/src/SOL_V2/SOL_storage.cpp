@@ -0,0 +1,324 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_storage.cpp
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Data log for SOL_V2, kept in the I2C EEPROM or, with SOL_FLASH_LOG, in a flash partition
+ *
+ * 	Records are appended at the head and read back from the tail, the oldest record the server
+ * 	has not acknowledged. When the log is full the oldest records are overwritten.
+ */
+
+#include <Arduino.h>
+#include <SOL_board.h>
+
+#include "SOL_V2.h"
+#include "SOL_storage.h"
+#include "SOL_trace.h"
+
+#ifdef SOL_FLASH_LOG
+#include <esp_partition.h>
+#include <SOL_flashlog.h>
+
+// Found and mapped again every wake, mappings do not survive deep sleep
+static const esp_partition_t * log_partition = NULL;
+static const uint8_t * log_map = NULL;
+static spi_flash_mmap_handle_t log_map_handle;
+
+/**
+ * @brief Flash traits for the data log partition, see SOL_flashlog.h
+ *
+ * 	Reads come from the memory mapped partition, the flash driver invalidates the cache
+ * 	over anything written or erased.
+ */
+struct SOL_flash_partition
+{
+	static constexpr uint32_t SECTOR_SIZE = SPI_FLASH_SEC_SIZE;
+
+	static uint32_t size(void)
+	{
+		return (log_partition != NULL) ? log_partition->size : 0;
+	}
+
+	static uint8_t read(uint32_t offset, void * data, uint32_t size)
+	{
+		if(log_map != NULL)
+		{
+			memcpy(data, log_map + offset, size);
+			return 1;
+		}
+		return log_partition != NULL && esp_partition_read(log_partition, offset, data, size) == ESP_OK;
+	}
+
+	static uint8_t write(uint32_t offset, const void * data, uint32_t size)
+	{
+		return log_partition != NULL && esp_partition_write(log_partition, offset, data, size) == ESP_OK;
+	}
+
+	static uint8_t eraseSector(uint32_t sector)
+	{
+		return log_partition != NULL && esp_partition_erase_range(log_partition, sector * SECTOR_SIZE, SECTOR_SIZE) == ESP_OK;
+	}
+};
+
+// Head and tail, kept through deep sleep so the partition is only scanned after power on
+RTC_DATA_ATTR SOL_flashlog_t flash_log;
+
+#else
+
+// The record size only needs checking once per power on
+RTC_DATA_ATTR uint8_t recordSizeChecked = 0;
+
+/**
+ * @brief Gets the address of the head or tail of the EEPROM log
+ *
+ * @param location EEPROM_ADDRESS_NEXT_STORAGE_ADDRESS or EEPROM_ADDRESS_TAIL_STORAGE_ADDRESS
+ *
+ * @return The address
+ *
+ */
+static uint16_t SOL_storageReadAddress(uint16_t location)
+{
+	uint16_t address;
+	SOL_readEEPROMNByte(location, (uint8_t *) &address, 2);
+	return address;
+}
+
+/**
+ * @brief Checks an address is the start of a record slot in the EEPROM log
+ *
+ * @param address The address
+ *
+ * @return 1 if the address is a record slot, otherwise 0
+ *
+ */
+static uint8_t SOL_storageValidAddress(uint16_t address)
+{
+	return address >= EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS
+		&& address + sizeof(data_packet_t) <= EEPROM_ADDRESS_DATA_RANGE_END_ADDRESS
+		&& (address - EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS) % sizeof(data_packet_t) == 0;
+}
+
+#endif
+
+/**
+ * @brief Prepares the data log, emptying it if it was written with another record format
+ *
+ * @return 1 if the log is ready, otherwise 0
+ */
+uint8_t SOL_storageBegin(void)
+{
+	#ifdef SOL_FLASH_LOG
+	log_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t) FLASH_LOG_PARTITION_SUBTYPE, FLASH_LOG_PARTITION_LABEL);
+	if(log_partition == NULL)
+	{
+		SOL_TRACE_ERROR(SOL_TRACE_STORAGE_ERROR, 0, 0);
+		return 0;
+	}
+
+	// Reading through the cache is far faster than a driver read per record, but optional
+	const void * map;
+	if(esp_partition_mmap(log_partition, 0, log_partition->size, SPI_FLASH_MMAP_DATA, &map, &log_map_handle) == ESP_OK)
+	{
+		log_map = (const uint8_t *) map;
+	}
+
+	// Sectors written with another record size are not part of the log, so it starts empty
+	if(!flash_log.mounted && !SOL_flashlogMount<SOL_flash_partition, data_packet_t>(&flash_log))
+	{
+		SOL_TRACE_ERROR(SOL_TRACE_STORAGE_ERROR, 0, log_partition->size);
+		return 0;
+	}
+	#else
+	// Records stored by firmware with another format can't be read back
+	if(!recordSizeChecked)
+	{
+		uint8_t record_size = SOL_readEEPROMByte(EEPROM_ADDRESS_RECORD_SIZE);
+		if(record_size == 0xFF)
+		{
+			// Erased, or written before the size was recorded, so keep the log as it is
+			SOL_writeEEPROMByte(EEPROM_ADDRESS_RECORD_SIZE, (uint8_t) sizeof(data_packet_t));
+		}
+		else if(record_size != sizeof(data_packet_t))
+		{
+			SOL_TRACE_WARN(SOL_TRACE_RECORD_FORMAT, record_size, sizeof(data_packet_t));
+			SOL_resetStorage();
+		}
+
+		// Never set, or past the end of a log region that has since shrunk
+		uint16_t head = SOL_storageReadAddress(EEPROM_ADDRESS_NEXT_STORAGE_ADDRESS);
+		uint16_t tail = SOL_storageReadAddress(EEPROM_ADDRESS_TAIL_STORAGE_ADDRESS);
+		if(!SOL_storageValidAddress(head) || !SOL_storageValidAddress(tail))
+		{
+			SOL_TRACE_WARN(SOL_TRACE_STORAGE_ERROR, 0, head);
+			SOL_resetStorage();
+		}
+		recordSizeChecked = 1;
+	}
+	#endif
+
+	return 1;
+}
+
+/**
+ * @brief Gets the number of records waiting for upload
+ *
+ * @return The number of records
+ */
+uint32_t SOL_storageCount(void)
+{
+	#ifdef SOL_FLASH_LOG
+	return flash_log.mounted ? SOL_flashlogCount<SOL_flash_partition, data_packet_t>(&flash_log) : 0;
+	#else
+	return SOL_logCount<SOL_board, data_packet_t>(
+		SOL_storageReadAddress(EEPROM_ADDRESS_NEXT_STORAGE_ADDRESS),
+		SOL_storageReadAddress(EEPROM_ADDRESS_TAIL_STORAGE_ADDRESS));
+	#endif
+}
+
+/**
+ * @brief Gets the number of records the data log can hold
+ *
+ * @return The number of records
+ */
+uint32_t SOL_storageCapacity(void)
+{
+	#ifdef SOL_FLASH_LOG
+	return flash_log.mounted ? SOL_flashlogCapacity<SOL_flash_partition, data_packet_t>(&flash_log) : 0;
+	#else
+	// One slot is always left empty to tell a full log from an empty one
+	return SOL_logCapacity<SOL_board, data_packet_t>();
+	#endif
+}
+
+/**
+ * @brief Appends a record, overwriting the oldest records when the log is full
+ *
+ * @param data Pointer to the record
+ *
+ * @return 1 if the record was stored, otherwise 0
+ */
+uint8_t SOL_storageAppend(const data_packet_t * data)
+{
+	#ifdef SOL_FLASH_LOG
+	if(log_partition == NULL || !SOL_flashlogAppend<SOL_flash_partition, data_packet_t>(&flash_log, data))
+	{
+		SOL_TRACE_ERROR(SOL_TRACE_STORAGE_ERROR, 1, data->seq);
+		return 0;
+	}
+	#else
+	uint16_t head = SOL_storageReadAddress(EEPROM_ADDRESS_NEXT_STORAGE_ADDRESS);
+	uint16_t tail = SOL_storageReadAddress(EEPROM_ADDRESS_TAIL_STORAGE_ADDRESS);
+
+	// Save data and location of it
+	SOL_writeEEPROMNByte(head, (uint8_t *) data, sizeof(data_packet_t));
+	head = SOL_logNext<SOL_board, data_packet_t>(head);
+
+	// When full, the oldest unacknowledged record was just overwritten
+	if(head == tail)
+	{
+		tail = SOL_logNext<SOL_board, data_packet_t>(tail);
+		SOL_writeEEPROMNByte(EEPROM_ADDRESS_TAIL_STORAGE_ADDRESS, (uint8_t *) &tail, 2);
+	}
+
+	SOL_writeEEPROMNByte(EEPROM_ADDRESS_NEXT_STORAGE_ADDRESS, (uint8_t *) &head, 2);
+	#endif
+
+	return 1;
+}
+
+/**
+ * @brief Reads a record waiting for upload
+ *
+ * @param idx Index of the record, 0 is the oldest
+ * @param data Pointer to put the record in
+ *
+ * @return 1 if the record was read, otherwise 0
+ */
+uint8_t SOL_storagePeek(uint32_t idx, data_packet_t * data)
+{
+	#ifdef SOL_FLASH_LOG
+	// Also fails on a record cut short by a reset while it was written
+	return SOL_flashlogPeek<SOL_flash_partition, data_packet_t>(&flash_log, idx, data);
+	#else
+	if(idx >= SOL_storageCount())
+	{
+		return 0;
+	}
+
+	const uint32_t slots = SOL_logCapacity<SOL_board, data_packet_t>() + 1;
+	uint16_t tail = SOL_storageReadAddress(EEPROM_ADDRESS_TAIL_STORAGE_ADDRESS);
+	uint32_t slot = ((tail - EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS) / sizeof(data_packet_t) + idx) % slots;
+
+	SOL_readEEPROMNByte(EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS + slot * sizeof(data_packet_t), (uint8_t *) data, sizeof(data_packet_t));
+	return 1;
+	#endif
+}
+
+/**
+ * @brief Drops the oldest records once the server has acknowledged them
+ *
+ * @param count The number of records to drop
+ *
+ */
+void SOL_storageDrop(uint32_t count)
+{
+	#ifdef SOL_FLASH_LOG
+	if(!SOL_flashlogDrop<SOL_flash_partition, data_packet_t>(&flash_log, count))
+	{
+		SOL_TRACE_ERROR(SOL_TRACE_STORAGE_ERROR, 2, count);
+	}
+	#else
+	uint16_t head = SOL_storageReadAddress(EEPROM_ADDRESS_NEXT_STORAGE_ADDRESS);
+	uint16_t tail = SOL_storageReadAddress(EEPROM_ADDRESS_TAIL_STORAGE_ADDRESS);
+
+	for(uint32_t i = 0; i < count && tail != head; i++)
+	{
+		tail = SOL_logNext<SOL_board, data_packet_t>(tail);
+	}
+	SOL_writeEEPROMNByte(EEPROM_ADDRESS_TAIL_STORAGE_ADDRESS, (uint8_t *) &tail, 2);
+	#endif
+}
+
+/**
+ * @brief Empties the data log and records the format it is written in, sequence numbers keep counting
+ *
+ */
+void SOL_resetStorage(void)
+{
+	#ifdef SOL_FLASH_LOG
+	// Each sector records the size of its records, so there is nothing else to record
+	if(log_partition == NULL || !SOL_flashlogFormat<SOL_flash_partition, data_packet_t>(&flash_log))
+	{
+		SOL_TRACE_ERROR(SOL_TRACE_STORAGE_ERROR, 3, 0);
+	}
+	#else
+	uint16_t next_storage = EEPROM_ADDRESS_DATA_RANGE_START_ADDRESS;
+	SOL_writeEEPROMNByte(EEPROM_ADDRESS_NEXT_STORAGE_ADDRESS, (uint8_t *) &next_storage, 2);
+	SOL_writeEEPROMNByte(EEPROM_ADDRESS_TAIL_STORAGE_ADDRESS, (uint8_t *) &next_storage, 2);
+	SOL_writeEEPROMByte(EEPROM_ADDRESS_RECORD_SIZE, (uint8_t) sizeof(data_packet_t));
+	#endif
+}
@@ -0,0 +1,97 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_storage.h
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Data log for SOL_V2, kept in the I2C EEPROM or, with SOL_FLASH_LOG, in a flash partition
+ *
+ * 	Records are appended at the head and read back from the tail, the oldest record the server
+ * 	has not acknowledged. When the log is full the oldest records are overwritten.
+ */
+
+
+#ifndef SOL_storage_h
+#define SOL_storage_h
+
+#include <Arduino.h>
+
+#include "SOL_V2.h"
+
+/**
+ * @brief Prepares the data log, emptying it if it was written with another record format
+ *
+ * @return 1 if the log is ready, otherwise 0
+ */
+uint8_t SOL_storageBegin(void);
+
+/**
+ * @brief Gets the number of records waiting for upload
+ *
+ * @return The number of records
+ */
+uint32_t SOL_storageCount(void);
+
+/**
+ * @brief Gets the number of records the data log can hold
+ *
+ * @return The number of records
+ */
+uint32_t SOL_storageCapacity(void);
+
+/**
+ * @brief Appends a record, overwriting the oldest records when the log is full
+ *
+ * @param data Pointer to the record
+ *
+ * @return 1 if the record was stored, otherwise 0
+ */
+uint8_t SOL_storageAppend(const data_packet_t * data);
+
+/**
+ * @brief Reads a record waiting for upload
+ *
+ * @param idx Index of the record, 0 is the oldest
+ * @param data Pointer to put the record in
+ *
+ * @return 1 if the record was read, otherwise 0
+ */
+uint8_t SOL_storagePeek(uint32_t idx, data_packet_t * data);
+
+/**
+ * @brief Drops the oldest records once the server has acknowledged them
+ *
+ * @param count The number of records to drop
+ *
+ */
+void SOL_storageDrop(uint32_t count);
+
+/**
+ * @brief Empties the data log and records the format it is written in, sequence numbers keep counting
+ *
+ */
+void SOL_resetStorage(void);
+
+#endif
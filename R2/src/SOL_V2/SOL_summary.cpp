@@ -0,0 +1,203 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_summary.cpp
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Daily energy summaries for SOL_V2, aggregated in RTC memory from each sample
+ */
+
+#include <Arduino.h>
+
+#include "SOL_V2.h"
+#include "SOL_summary.h"
+#include "SOL_schedule.h"
+#include "SOL_trace.h"
+
+#define SECONDS_PER_DAY			86400UL
+
+// Day being aggregated, kept through deep sleep
+RTC_DATA_ATTR daily_summary_t summary_today;
+RTC_DATA_ATTR uint32_t summary_last_time = 0;
+RTC_DATA_ATTR float summary_last_power_mW = 0.0;
+RTC_DATA_ATTR uint32_t summary_above_seconds = 0;
+RTC_DATA_ATTR uint32_t summary_bin_seconds[SUMMARY_HISTOGRAM_BINS];
+
+// Finished days waiting for upload, oldest first from summary_first
+RTC_DATA_ATTR daily_summary_t summary_pending[SUMMARY_PENDING_COUNT];
+RTC_DATA_ATTR uint8_t summary_first = 0;
+RTC_DATA_ATTR uint8_t summary_count = 0;
+
+/**
+ * @brief Finds the histogram bin of a power
+ *
+ * @param power_mW The power
+ *
+ * @return The bin, each bin's upper edge doubles from SUMMARY_HISTOGRAM_BASE_MW
+ */
+static uint8_t SOL_summaryBin(float power_mW)
+{
+	uint8_t bin = 0;
+	float edge = SUMMARY_HISTOGRAM_BASE_MW;
+	while(bin < SUMMARY_HISTOGRAM_BINS - 1 && power_mW >= edge)
+	{
+		bin++;
+		edge *= 2.0;
+	}
+	return bin;
+}
+
+/**
+ * @brief Starts aggregating a new day
+ *
+ * @param day The local day
+ *
+ */
+static void SOL_summaryStartDay(uint32_t day)
+{
+	memset(&summary_today, 0, sizeof(summary_today));
+	summary_today.day = day;
+	summary_above_seconds = 0;
+	memset(summary_bin_seconds, 0, sizeof(summary_bin_seconds));
+}
+
+/**
+ * @brief Moves the day being aggregated to the upload queue, dropping the oldest day if it is full
+ *
+ */
+static void SOL_summaryFinishDay(void)
+{
+	summary_today.minutes_above = summary_above_seconds / 60;
+	for(uint8_t bin = 0; bin < SUMMARY_HISTOGRAM_BINS; bin++)
+	{
+		summary_today.histogram_minutes[bin] = summary_bin_seconds[bin] / 60;
+	}
+
+	if(summary_count == SUMMARY_PENDING_COUNT)
+	{
+		summary_first = (summary_first + 1) % SUMMARY_PENDING_COUNT;
+		summary_count--;
+	}
+
+	summary_pending[(summary_first + summary_count) % SUMMARY_PENDING_COUNT] = summary_today;
+	summary_count++;
+
+	SOL_TRACE_INFO(SOL_TRACE_SUMMARY, summary_today.day, SOL_traceFloat(summary_today.energy_mWh));
+}
+
+/**
+ * @brief Adds a sample to the running daily aggregates, finishing the previous day's summary on the first sample of a new day
+ *
+ * 	Energy is integrated with the trapezoidal rule between consecutive samples. Gaps longer than
+ * 	SUMMARY_MAX_GAP_SECONDS, such as the night, add nothing. Days are local mean solar days once
+ * 	the site location is known, so a day never splits around noon.
+ *
+ * @param time Seconds since January 1st, 1970, or 0 if unknown, in which case the sample is skipped
+ * @param peak_power_mW The peak power of the sample
+ *
+ */
+void SOL_summaryAddSample(uint32_t time, float peak_power_mW)
+{
+	if(time == 0)
+	{
+		return;
+	}
+
+	uint32_t day = (time + SOL_siteSolarOffset()) / SECONDS_PER_DAY;
+
+	if(summary_today.samples == 0 || day != summary_today.day)
+	{
+		if(summary_today.samples > 0)
+		{
+			SOL_summaryFinishDay();
+		}
+
+		// The interval back to yesterday's last sample is at night, so it starts fresh
+		SOL_summaryStartDay(day);
+		summary_today.min_power_mW = peak_power_mW;
+	}
+	else if(time > summary_last_time && time - summary_last_time <= SUMMARY_MAX_GAP_SECONDS)
+	{
+		uint32_t dt = time - summary_last_time;
+		float mean_power_mW = 0.5 * (peak_power_mW + summary_last_power_mW);
+
+		summary_today.energy_mWh += mean_power_mW * dt / 3600.0;
+		summary_bin_seconds[SOL_summaryBin(mean_power_mW)] += dt;
+		if(mean_power_mW >= SUMMARY_ABOVE_THRESHOLD_MW)
+		{
+			summary_above_seconds += dt;
+		}
+	}
+
+	if(peak_power_mW < summary_today.min_power_mW)
+	{
+		summary_today.min_power_mW = peak_power_mW;
+	}
+	if(peak_power_mW > summary_today.max_power_mW)
+	{
+		summary_today.max_power_mW = peak_power_mW;
+	}
+	summary_today.samples++;
+
+	summary_last_time = time;
+	summary_last_power_mW = peak_power_mW;
+}
+
+/**
+ * @brief Gets the number of finished daily summaries waiting for upload
+ *
+ * @return The number of summaries
+ */
+uint8_t SOL_summaryPendingCount(void)
+{
+	return summary_count;
+}
+
+/**
+ * @brief Gets a finished daily summary waiting for upload
+ *
+ * @param idx Index of the summary, 0 is the oldest
+ *
+ * @return The summary
+ */
+daily_summary_t SOL_summaryGetPending(uint8_t idx)
+{
+	return summary_pending[(summary_first + idx) % SUMMARY_PENDING_COUNT];
+}
+
+/**
+ * @brief Drops the summaries the server has acknowledged
+ *
+ * @param day The last day the server has stored
+ *
+ */
+void SOL_summaryAcknowledge(uint32_t day)
+{
+	while(summary_count > 0 && summary_pending[summary_first].day <= day)
+	{
+		summary_first = (summary_first + 1) % SUMMARY_PENDING_COUNT;
+		summary_count--;
+	}
+}
@@ -0,0 +1,77 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_summary.h
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Daily energy summaries for SOL_V2, aggregated in RTC memory from each sample
+ */
+
+
+#ifndef SOL_summary_h
+#define SOL_summary_h
+
+#include <Arduino.h>
+
+#include "SOL_V2.h"
+
+/**
+ * @brief Adds a sample to the running daily aggregates, finishing the previous day's summary on the first sample of a new day
+ *
+ * 	Energy is integrated with the trapezoidal rule between consecutive samples. Gaps longer than
+ * 	SUMMARY_MAX_GAP_SECONDS, such as the night, add nothing. Days are local mean solar days once
+ * 	the site location is known, so a day never splits around noon.
+ *
+ * @param time Seconds since January 1st, 1970, or 0 if unknown, in which case the sample is skipped
+ * @param peak_power_mW The peak power of the sample
+ *
+ */
+void SOL_summaryAddSample(uint32_t time, float peak_power_mW);
+
+/**
+ * @brief Gets the number of finished daily summaries waiting for upload
+ *
+ * @return The number of summaries
+ */
+uint8_t SOL_summaryPendingCount(void);
+
+/**
+ * @brief Gets a finished daily summary waiting for upload
+ *
+ * @param idx Index of the summary, 0 is the oldest
+ *
+ * @return The summary
+ */
+daily_summary_t SOL_summaryGetPending(uint8_t idx);
+
+/**
+ * @brief Drops the summaries the server has acknowledged
+ *
+ * @param day The last day the server has stored
+ *
+ */
+void SOL_summaryAcknowledge(uint32_t day);
+
+#endif
@@ -0,0 +1,198 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_time.cpp
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Drift-aware timekeeping for SOL_V2, so NTP only runs when the time error needs it
+ */
+
+#include <Arduino.h>
+
+#include "SOL_V2.h"
+#include "SOL_time.h"
+#include "SOL_trace.h"
+
+#define US_PER_SECOND			1000000.0
+#define PPM						1000000.0
+
+// Local clock, the ESP32 timer through sleep plus millis() while awake, kept through deep sleep
+RTC_DATA_ATTR uint64_t time_uptime_us = 0;
+
+// Last correction, time is extrapolated from here
+RTC_DATA_ATTR uint8_t time_valid = 0;
+RTC_DATA_ATTR uint32_t time_base = 0;
+RTC_DATA_ATTR uint64_t time_base_uptime_us = 0;
+RTC_DATA_ATTR float time_base_error_s = 0.0;
+RTC_DATA_ATTR uint32_t time_last_ntp = 0;
+
+// Drift is measured between corrections at least TIME_DRIFT_MIN_INTERVAL_SECONDS apart
+RTC_DATA_ATTR uint32_t time_anchor = 0;
+RTC_DATA_ATTR uint64_t time_anchor_uptime_us = 0;
+RTC_DATA_ATTR uint8_t time_drift_known = 0;
+RTC_DATA_ATTR float time_drift_ppm = 0.0;							// Positive when the local clock runs slow
+RTC_DATA_ATTR float time_drift_uncertainty_ppm = TIME_DRIFT_DEFAULT_PPM;
+
+/**
+ * @brief Gets the local clock
+ *
+ * @return Microseconds since the first wake
+ */
+static uint64_t SOL_timeUptime(void)
+{
+	return time_uptime_us + (uint64_t) millis() * 1000;
+}
+
+/**
+ * @brief Adds the time awake and the coming sleep to the local clock, call just before deep sleep
+ *
+ * @param len The time to sleep in seconds
+ *
+ */
+void SOL_timeSleep(uint32_t len)
+{
+	time_uptime_us = SOL_timeUptime() + (uint64_t) len * 1000000;
+}
+
+/**
+ * @brief Corrects the time, updating the drift estimate when the last estimate is old enough
+ *
+ * @param time Seconds since January 1st, 1970
+ * @param source Where the time came from, which sets how far it can be trusted
+ *
+ */
+void SOL_timeCorrect(uint32_t time, SOL_time_source_t source)
+{
+	uint64_t uptime = SOL_timeUptime();
+
+	if(time_valid)
+	{
+		SOL_TRACE_INFO(SOL_TRACE_TIME_CORRECT, source, (int32_t) (time - SOL_getTime()));
+	}
+
+	// Measure drift over a long interval, so whole second corrections are precise enough
+	if(time_valid && uptime - time_anchor_uptime_us >= (uint64_t) TIME_DRIFT_MIN_INTERVAL_SECONDS * 1000000)
+	{
+		float local_s = (uptime - time_anchor_uptime_us) / US_PER_SECOND;
+		float measured_ppm = ((float) (time - time_anchor) / local_s - 1.0) * PPM;
+
+		if(time_drift_known)
+		{
+			time_drift_uncertainty_ppm = fabs(measured_ppm - time_drift_ppm);
+			if(time_drift_uncertainty_ppm < TIME_DRIFT_MIN_PPM)
+			{
+				time_drift_uncertainty_ppm = TIME_DRIFT_MIN_PPM;
+			}
+			time_drift_ppm += TIME_DRIFT_GAIN * (measured_ppm - time_drift_ppm);
+		}
+		else
+		{
+			time_drift_ppm = measured_ppm;
+			time_drift_known = 1;
+		}
+
+		SOL_TRACE_INFO(SOL_TRACE_TIME_DRIFT, SOL_traceFloat(time_drift_ppm), SOL_traceFloat(time_drift_uncertainty_ppm));
+
+		time_anchor = time;
+		time_anchor_uptime_us = uptime;
+	}
+	else if(!time_valid)
+	{
+		time_anchor = time;
+		time_anchor_uptime_us = uptime;
+	}
+
+	// The RTC is only as good as its drift since it was set from NTP
+	if(source == SOL_TIME_SOURCE_NTP)
+	{
+		time_last_ntp = time;
+		time_base_error_s = TIME_NTP_ERROR_SECONDS;
+	}
+	else
+	{
+		time_base_error_s = TIME_NTP_ERROR_SECONDS + TIME_RTC_ERROR_SECONDS + (time - time_last_ntp) * (TIME_RTC_DRIFT_PPM / PPM);
+	}
+
+	time_base = time;
+	time_base_uptime_us = uptime;
+	time_valid = 1;
+}
+
+/**
+ * @brief Predicts the current time error from the drift uncertainty and time since the last correction
+ *
+ * @return The predicted error in seconds
+ */
+float SOL_timePredictedError(void)
+{
+	float local_s = (SOL_timeUptime() - time_base_uptime_us) / US_PER_SECOND;
+	return time_base_error_s + local_s * (time_drift_uncertainty_ppm / PPM);
+}
+
+/**
+ * @brief Checks if time should be requested from NTP
+ *
+ * @return 1 if time is unknown or the predicted error exceeds TIME_MAX_ERROR_SECONDS, otherwise 0
+ */
+uint8_t SOL_timeNeedsSync(void)
+{
+	if(!time_valid)
+	{
+		return 1;
+	}
+
+	float error_s = SOL_timePredictedError();
+	SOL_TRACE_DEBUG(SOL_TRACE_TIME_ERROR, SOL_traceFloat(error_s), 0);
+
+	return error_s > TIME_MAX_ERROR_SECONDS;
+}
+
+/**
+ * @brief Gets the current time, corrected for estimated drift
+ *
+ * @return Seconds since January 1st, 1970, or 0 if time has never been set
+ */
+uint32_t SOL_getTime(void)
+{
+	if(!time_valid)
+	{
+		return 0;
+	}
+
+	float local_s = (SOL_timeUptime() - time_base_uptime_us) / US_PER_SECOND;
+	return time_base + (uint32_t) (local_s * (1.0 + time_drift_ppm / PPM) + 0.5);
+}
+
+/**
+ * @brief Gets a time that keeps counting even if time has never been set
+ *
+ * 	Counts from the first wake, awake and asleep, and never jumps on corrections.
+ *
+ * @return Seconds since the first wake
+ */
+uint32_t SOL_getRawTime(void)
+{
+	return (uint32_t) (SOL_timeUptime() / 1000000);
+}
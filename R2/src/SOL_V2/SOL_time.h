@@ -0,0 +1,94 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_time.h
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Drift-aware timekeeping for SOL_V2, so NTP only runs when the time error needs it
+ */
+
+
+#ifndef SOL_time_h
+#define SOL_time_h
+
+#include <Arduino.h>
+
+/**
+ * @brief Sources of a time correction
+ */
+typedef enum SOL_time_source_t
+{
+	SOL_TIME_SOURCE_NTP = 0,
+	SOL_TIME_SOURCE_RTC
+} SOL_time_source_t;
+
+/**
+ * @brief Adds the time awake and the coming sleep to the local clock, call just before deep sleep
+ *
+ * @param len The time to sleep in seconds
+ *
+ */
+void SOL_timeSleep(uint32_t len);
+
+/**
+ * @brief Corrects the time, updating the drift estimate when the last estimate is old enough
+ *
+ * @param time Seconds since January 1st, 1970
+ * @param source Where the time came from, which sets how far it can be trusted
+ *
+ */
+void SOL_timeCorrect(uint32_t time, SOL_time_source_t source);
+
+/**
+ * @brief Predicts the current time error from the drift uncertainty and time since the last correction
+ *
+ * @return The predicted error in seconds
+ */
+float SOL_timePredictedError(void);
+
+/**
+ * @brief Checks if time should be requested from NTP
+ *
+ * @return 1 if time is unknown or the predicted error exceeds TIME_MAX_ERROR_SECONDS, otherwise 0
+ */
+uint8_t SOL_timeNeedsSync(void);
+
+/**
+ * @brief Gets the current time, corrected for estimated drift
+ *
+ * @return Seconds since January 1st, 1970, or 0 if time has never been set
+ */
+uint32_t SOL_getTime(void);
+
+/**
+ * @brief Gets a time that keeps counting even if time has never been set
+ *
+ * 	Counts from the first wake, awake and asleep, and never jumps on corrections.
+ *
+ * @return Seconds since the first wake
+ */
+uint32_t SOL_getRawTime(void);
+
+#endif
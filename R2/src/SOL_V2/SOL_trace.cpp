@@ -0,0 +1,165 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_trace.cpp
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Binary event log kept in RTC memory, decoded on a PC with tools/sol_trace_decode.py
+ */
+
+#include <Arduino.h>
+
+#include "SOL_trace.h"
+
+// Ring buffer of events, kept through deep sleep
+RTC_DATA_ATTR SOL_trace_event_t trace_buffer[SOL_TRACE_BUFFER_SIZE];
+RTC_DATA_ATTR uint32_t trace_count = 0;
+RTC_DATA_ATTR uint16_t trace_wake = 0;
+RTC_DATA_ATTR uint8_t trace_warning = 0;
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+/**
+ * @brief Starts tracing a new wake
+ *
+ */
+void SOL_traceBegin(void)
+{
+	trace_wake++;
+}
+
+/**
+ * @brief Adds an event to the trace. Use the SOL_TRACE_ macros instead so levels compile out
+ *
+ * @param level The event level
+ * @param id The event ID
+ * @param a The first argument
+ * @param b The second argument
+ *
+ */
+void SOL_trace(uint8_t level, SOL_trace_id_t id, uint32_t a, uint32_t b)
+{
+	SOL_trace_event_t * event = &trace_buffer[trace_count % SOL_TRACE_BUFFER_SIZE];
+	event->id = (uint8_t) id;
+	event->level = level;
+	event->wake = trace_wake;
+	event->time_ms = millis();
+	event->args[0] = a;
+	event->args[1] = b;
+
+	trace_count++;
+
+	if(level <= SOL_TRACE_LEVEL_WARN)
+	{
+		trace_warning = 1;
+	}
+}
+
+/**
+ * @brief Packs a float into a trace argument
+ *
+ * @param value The float
+ *
+ * @return The bits of the float
+ *
+ */
+uint32_t SOL_traceFloat(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+/**
+ * @brief Checks if a warning or error was traced since the trace was last uploaded
+ *
+ * @return 1 if a warning or error was traced, otherwise 0
+ */
+uint8_t SOL_traceHasWarning(void)
+{
+	return trace_warning;
+}
+
+/**
+ * @brief Appends the bytes of an event as hex
+ *
+ * @param str The String to append to
+ * @param event Pointer to the event
+ *
+ */
+static void SOL_traceAppendHex(String & str, const SOL_trace_event_t * event)
+{
+	const uint8_t * raw = (const uint8_t *) event;
+	for(uint8_t i = 0; i < sizeof(SOL_trace_event_t); i++)
+	{
+		str += hex_digits[raw[i] >> 4];
+		str += hex_digits[raw[i] & 0xF];
+	}
+}
+
+/**
+ * @brief Writes all events to Serial as hex lines, oldest first
+ *
+ */
+void SOL_traceDump(void)
+{
+	uint32_t first = (trace_count > SOL_TRACE_BUFFER_SIZE) ? trace_count - SOL_TRACE_BUFFER_SIZE : 0;
+
+	for(uint32_t i = first; i < trace_count; i++)
+	{
+		String line = "T:";
+		SOL_traceAppendHex(line, &trace_buffer[i % SOL_TRACE_BUFFER_SIZE]);
+		Serial.println(line);
+	}
+}
+
+/**
+ * @brief Formats all events as one hex string for upload, oldest first
+ *
+ * @return The hex string
+ *
+ */
+String SOL_traceToHex(void)
+{
+	uint32_t first = (trace_count > SOL_TRACE_BUFFER_SIZE) ? trace_count - SOL_TRACE_BUFFER_SIZE : 0;
+
+	String hex;
+	hex.reserve((trace_count - first) * sizeof(SOL_trace_event_t) * 2);
+	for(uint32_t i = first; i < trace_count; i++)
+	{
+		SOL_traceAppendHex(hex, &trace_buffer[i % SOL_TRACE_BUFFER_SIZE]);
+	}
+
+	return hex;
+}
+
+/**
+ * @brief Marks the trace as uploaded, clearing the warning flag
+ *
+ */
+void SOL_traceUploaded(void)
+{
+	trace_warning = 0;
+}
@@ -0,0 +1,194 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_trace.h
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Binary event log kept in RTC memory, decoded on a PC with tools/sol_trace_decode.py
+ */
+
+
+#ifndef SOL_trace_h
+#define SOL_trace_h
+
+#include <Arduino.h>
+
+#define SOL_TRACE_LEVEL_NONE							0
+#define SOL_TRACE_LEVEL_ERROR							1
+#define SOL_TRACE_LEVEL_WARN							2
+#define SOL_TRACE_LEVEL_INFO							3
+#define SOL_TRACE_LEVEL_DEBUG							4
+
+// Events above this level are compiled out
+#ifndef SOL_TRACE_LEVEL
+#define SOL_TRACE_LEVEL									SOL_TRACE_LEVEL_INFO
+#endif
+
+#define SOL_TRACE_BUFFER_SIZE							64					// Number of events kept, oldest are overwritten
+
+/**
+ * @brief Trace event IDs
+ *
+ * 	The comment after each ID is the format used by tools/sol_trace_decode.py, which reads this file.
+ * 	Never renumber an ID, only add new ones.
+ */
+typedef enum SOL_trace_id_t
+{
+	SOL_TRACE_BOOT = 1,									// "Wakeup cause %u, sleep count %u"
+	SOL_TRACE_TOUCH = 2,								// "Touch sensed"
+	SOL_TRACE_PROVISION_START = 3,						// "Starting provisioning"
+	SOL_TRACE_PROVISIONED = 4,							// "Provisioned, success %u"
+	SOL_TRACE_CREDENTIALS = 5,							// "Credentials %u, SSID length %u"
+	SOL_TRACE_DATAPOINTS = 6,							// "Number of datapoints: %u"
+	SOL_TRACE_WIFI_CONNECTING = 7,						// "Connecting to WiFi, timeout %u s"
+	SOL_TRACE_WIFI_CONNECTED = 8,						// "Connected to WiFi after %u ms"
+	SOL_TRACE_WIFI_TIMEOUT = 9,							// "Could not connect, timeout after %u ms"
+	SOL_TRACE_UPLOAD_RECORD = 10,						// "Uploading record %u, time %u"
+	SOL_TRACE_HTTP_RESPONSE = 11,						// "Server responded %u, %u bytes"
+	SOL_TRACE_SAMPLE = 12,								// "New datapoint: time %u, sequence %u"
+	SOL_TRACE_SAMPLE_POWER = 13,						// "Power %f mW, current %f mA"
+	SOL_TRACE_SAMPLE_VOLTAGE = 14,						// "Voltage %f V, battery %f V"
+	SOL_TRACE_SAMPLE_TEMP = 15,							// "Temp %f C"
+	SOL_TRACE_SLEEP = 16,								// "Sleeping %u s, temp %f C"
+	SOL_TRACE_NTP_TIME = 17,							// "NTP time %u"
+	SOL_TRACE_PHASE = 18,								// "Phase %p took %u us"
+	SOL_TRACE_NIGHT_SKIP = 19,							// "Dark, open circuit %f V, sleeping %u s"
+	SOL_TRACE_SCHEDULE = 20,							// "Next sample in %u s, burst samples left %u"
+	SOL_TRACE_BURST_START = 21,							// "Burst started, power %f mW, recent mean %f mW"
+	SOL_TRACE_UPLOAD_POLICY = 22,						// "Upload reason %u (0 defer, 1 log full, 2 overdue, 3 charging), battery %f V"
+	SOL_TRACE_WIFI_BACKOFF = 23,						// "WiFi backing off after %u failures, %u s left"
+	SOL_TRACE_UPLOAD_ACK = 24,							// "Upload from sequence %u, %u accepted"
+	SOL_TRACE_RTC_ALARM = 25,							// "RTC alarm set for %u, sleeping %u s"
+	SOL_TRACE_TIME_CORRECT = 26,						// "Time corrected from source %u (0 NTP, 1 RTC) by %d s"
+	SOL_TRACE_TIME_DRIFT = 27,							// "Drift estimate %f ppm, uncertainty %f ppm"
+	SOL_TRACE_TIME_ERROR = 28,							// "Predicted time error %f s"
+	SOL_TRACE_MPP_FIT = 29,								// "MPP fit confidence %f, dense search %u"
+	SOL_TRACE_CURVE = 30,								// "I-V curve captured, %u points, shift %u"
+	SOL_TRACE_SUMMARY = 31,								// "Day %u summarized, energy %f mWh"
+	SOL_TRACE_REF_CELL = 32,							// "Reference cell %u, %f W/m2"
+	SOL_TRACE_RECORD_FORMAT = 33,						// "Record size changed from %u to %u bytes, data log reset"
+	SOL_TRACE_PHASE_OVERRUN = 34,						// "Phase %u passed its deadline after %u ms"
+	SOL_TRACE_WAKE_BUDGET = 35,							// "Wake budget spent in phase %u, cut off after %u ms"
+	SOL_TRACE_POWER_MODE = 36,							// "Power mode %u (0 normal, 1 reduced, 2 log only, 3 survival), battery %f V"
+	SOL_TRACE_STORAGE_ERROR = 37,						// "Data log failed to %u (0 mount, 1 append, 2 drop, 3 format), %u"
+	SOL_TRACE_CONFIG = 38,								// "Settings version %u from server, applied %u"
+	SOL_TRACE_OTA_OFFER = 39,							// "Firmware %u offered, delta %u bytes"
+	SOL_TRACE_OTA_PROGRESS = 40,						// "Firmware delta at %u bytes, %u left"
+	SOL_TRACE_OTA_ERROR = 41,							// "Firmware update failed in step %u (0 header, 1 running image, 2 delta, 3 flash, 4 new image, 5 boot, 6 rolled back before), delta at %u"
+	SOL_TRACE_OTA_READY = 42,							// "Firmware %u verified, %u bytes, restarting"
+	SOL_TRACE_OTA_CONFIRMED = 43						// "Firmware %u reached the server, rollback cancelled"
+} SOL_trace_id_t;
+
+/**
+ * @brief A single trace event, 16 bytes
+ */
+typedef struct SOL_trace_event_t
+{
+	uint8_t id;
+	uint8_t level;
+	uint16_t wake;
+	uint32_t time_ms;
+	uint32_t args[2];
+} SOL_trace_event_t;
+
+#if SOL_TRACE_LEVEL >= SOL_TRACE_LEVEL_ERROR
+#define SOL_TRACE_ERROR(id, a, b)	SOL_trace(SOL_TRACE_LEVEL_ERROR, (id), (uint32_t) (a), (uint32_t) (b))
+#else
+#define SOL_TRACE_ERROR(id, a, b)
+#endif
+
+#if SOL_TRACE_LEVEL >= SOL_TRACE_LEVEL_WARN
+#define SOL_TRACE_WARN(id, a, b)	SOL_trace(SOL_TRACE_LEVEL_WARN, (id), (uint32_t) (a), (uint32_t) (b))
+#else
+#define SOL_TRACE_WARN(id, a, b)
+#endif
+
+#if SOL_TRACE_LEVEL >= SOL_TRACE_LEVEL_INFO
+#define SOL_TRACE_INFO(id, a, b)	SOL_trace(SOL_TRACE_LEVEL_INFO, (id), (uint32_t) (a), (uint32_t) (b))
+#else
+#define SOL_TRACE_INFO(id, a, b)
+#endif
+
+#if SOL_TRACE_LEVEL >= SOL_TRACE_LEVEL_DEBUG
+#define SOL_TRACE_DEBUG(id, a, b)	SOL_trace(SOL_TRACE_LEVEL_DEBUG, (id), (uint32_t) (a), (uint32_t) (b))
+#else
+#define SOL_TRACE_DEBUG(id, a, b)
+#endif
+
+/**
+ * @brief Starts tracing a new wake
+ *
+ */
+void SOL_traceBegin(void);
+
+/**
+ * @brief Adds an event to the trace. Use the SOL_TRACE_ macros instead so levels compile out
+ *
+ * @param level The event level
+ * @param id The event ID
+ * @param a The first argument
+ * @param b The second argument
+ *
+ */
+void SOL_trace(uint8_t level, SOL_trace_id_t id, uint32_t a, uint32_t b);
+
+/**
+ * @brief Packs a float into a trace argument
+ *
+ * @param value The float
+ *
+ * @return The bits of the float
+ *
+ */
+uint32_t SOL_traceFloat(float value);
+
+/**
+ * @brief Checks if a warning or error was traced since the trace was last uploaded
+ *
+ * @return 1 if a warning or error was traced, otherwise 0
+ */
+uint8_t SOL_traceHasWarning(void);
+
+/**
+ * @brief Writes all events to Serial as hex lines, oldest first
+ *
+ */
+void SOL_traceDump(void);
+
+/**
+ * @brief Formats all events as one hex string for upload, oldest first
+ *
+ * @return The hex string
+ *
+ */
+String SOL_traceToHex(void);
+
+/**
+ * @brief Marks the trace as uploaded, clearing the warning flag
+ *
+ */
+void SOL_traceUploaded(void);
+
+#endif
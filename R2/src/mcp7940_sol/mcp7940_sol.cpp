@@ -3,104 +3,120 @@
 
 #include "mcp7940_sol.h"
 
-static void startRTCOscillator(void)
+static uint8_t toBCD(uint8_t value)
 {
-	Wire.beginTransmission(MCP7940_ADDRESS);
-	Wire.write(byte(MCP7940_SECONDS));
-	Wire.endTransmission();
+	return ((value / 10) << 4) | (value % 10);
+}
 
-	Wire.requestFrom(MCP7940_ADDRESS, 1);
-	uint8_t seconds_register = Wire.read();
+static uint8_t fromBCD(uint8_t value)
+{
+	return (value >> 4) * 10 + (value & 0xF);
+}
 
-	seconds_register |= (1 << 7);
+// Days since January 1st, 1970 from a date, years treated as starting in March
+// so the leap day is last. See http://howardhinnant.github.io/date_algorithms.html
+static uint32_t daysFromCivil(uint32_t year, uint32_t month, uint32_t date)
+{
+	year -= (month <= 2);
+	uint32_t era = year / 400;
+	uint32_t year_of_era = year - era * 400;
+	uint32_t day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + date - 1;
+	uint32_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+	return era * 146097 + day_of_era - 719468;
+}
 
-	Wire.beginTransmission(MCP7940_ADDRESS);
-	Wire.write(byte(MCP7940_SECONDS));
-	Wire.write(seconds_register);
-	Wire.endTransmission();
+// Date from days since January 1st, 1970, the inverse of daysFromCivil
+static void civilFromDays(uint32_t days, uint16_t * year, uint8_t * month, uint8_t * date)
+{
+	days += 719468;
+	uint32_t era = days / 146097;
+	uint32_t day_of_era = days - era * 146097;
+	uint32_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+	uint32_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+	uint32_t month_from_march = (5 * day_of_year + 2) / 153;
+
+	*date = day_of_year - (153 * month_from_march + 2) / 5 + 1;
+	*month = month_from_march < 10 ? month_from_march + 3 : month_from_march - 9;
+	*year = year_of_era + era * 400 + (*month <= 2);
 }
 
-static void stopRTCOscillator(void)
+static uint8_t readRTCRegister(uint8_t reg)
 {
 	Wire.beginTransmission(MCP7940_ADDRESS);
-	Wire.write(byte(MCP7940_SECONDS));
-	Wire.endTransmission(false);
+	Wire.write(reg);
+	Wire.endTransmission();
 
 	Wire.requestFrom(MCP7940_ADDRESS, 1);
-	uint8_t seconds_register = Wire.read();
+	return Wire.read();
+}
 
-	seconds_register &= 0x7F;
+// Takes the seconds register as already read, so a running oscillator costs nothing
+static void startRTCOscillator(uint8_t seconds_register)
+{
+	if(seconds_register & MCP7940_SECONDS_ST)
+	{
+		return;
+	}
 
 	Wire.beginTransmission(MCP7940_ADDRESS);
 	Wire.write(byte(MCP7940_SECONDS));
-	Wire.write(seconds_register);
-	Wire.endTransmission(false);
+	Wire.write(seconds_register | MCP7940_SECONDS_ST);
+	Wire.endTransmission();
 }
 
 void RTCSetup(void)
 {
-	stopRTCOscillator();
-
 	Wire.beginTransmission(MCP7940_ADDRESS);
   	Wire.write(byte(MCP7940_CALIBRATION));
   	Wire.write(0x00); // turn off calibration
-  	Wire.endTransmission(false);
+  	Wire.endTransmission();
 
+  	// MFP idles high so it only pulls low on an alarm
   	Wire.beginTransmission(MCP7940_ADDRESS);
   	Wire.write(byte(MCP7940_CONTROL_REG));
-  	Wire.write(0x00);
-  	Wire.endTransmission(false);
+  	Wire.write(MCP7940_CONTROL_OUT);
+  	Wire.endTransmission();
 
-  	startRTCOscillator();
+  	startRTCOscillator(readRTCRegister(MCP7940_SECONDS));
 }
 
 void setRTCTime(uint8_t seconds, uint8_t minutes, uint8_t hour, 
-	uint8_t date, uint8_t month, uint16_t year)
+	uint8_t weekday, uint8_t date, uint8_t month, uint16_t year)
 {
-	uint8_t raw_data[7];
-
-	uint8_t ten_seconds = seconds / 10;
-	raw_data[0] = ((ten_seconds & 0xF) << 4) + ((seconds - 10*ten_seconds) & 0xF);
-	raw_data[0] |= (1 << 7);
-
-	uint8_t ten_minutes = minutes / 10;
-	raw_data[1] = ((ten_minutes & 0xF) << 4) + ((minutes - 10*ten_minutes) & 0xF);
-
-	uint8_t ten_hour = hour / 10;
-	raw_data[2] = ((ten_hour & 0x1) << 4) + ((hour - 10*ten_hour) & 0xF); // Set to 24 hour mode by bit 5 = 0
-
-	raw_data[3] = 0; // TODO set day?
-
-	uint8_t ten_date = date / 10;
-	raw_data[4] = ((ten_date & 0x3) << 4) + ((date - 10*ten_date) & 0xF);
-
-	uint8_t ten_month = month / 10;
-	raw_data[5] = ((ten_month & 0x1) << 4) + ((month - 10*ten_month) & 0xF);
-
-	uint8_t ten_year = year / 10;
-	raw_data[6] = ((ten_year & 0xF) << 4) + ((year - 10*ten_year) & 0xF);
-
-	//stopRTCOscillator();
-
+	// All time registers in one burst, the ST bit starts the oscillator with it
 	Wire.beginTransmission(MCP7940_ADDRESS);
 	Wire.write(byte(MCP7940_SECONDS));
-	for(int i = 0; i < 7; i++)
-	{
-		Wire.write(raw_data[i]);
-	}
+	Wire.write(toBCD(seconds) | MCP7940_SECONDS_ST);
+	Wire.write(toBCD(minutes));
+	Wire.write(toBCD(hour)); // Set to 24 hour mode by bit 6 = 0
+	Wire.write(weekday & 0x7); // 1 - 7, needed for alarm matching
+	Wire.write(toBCD(date));
+	Wire.write(toBCD(month));
+	Wire.write(toBCD(year % 100));
 	Wire.endTransmission();
+}
+
+void setRTCEpoch(uint32_t time)
+{
+	uint32_t days = time / 86400;
+	uint32_t seconds_of_day = time % 86400;
+
+	uint16_t year;
+	uint8_t month;
+	uint8_t date;
+	civilFromDays(days, &year, &month, &date);
 
-	startRTCOscillator();
+	setRTCTime(seconds_of_day % 60, (seconds_of_day / 60) % 60, seconds_of_day / 3600,
+		(days + 4) % 7 + 1, date, month, year);
 }
 
 uint32_t getRTCTime(void)
 {
-	startRTCOscillator();
-
 	uint8_t raw_data[7];
 
+	// All time registers in one burst, so they can't roll over between reads
 	Wire.beginTransmission(MCP7940_ADDRESS);
-	Wire.write(byte(0));
+	Wire.write(byte(MCP7940_SECONDS));
 	Wire.endTransmission();
 
 	Wire.requestFrom(MCP7940_ADDRESS, 7);
@@ -109,34 +125,74 @@ uint32_t getRTCTime(void)
 		raw_data[i] = Wire.read();
 	}
 
+	// A stopped oscillator means the time was lost
+	if(!(raw_data[0] & MCP7940_SECONDS_ST))
+	{
+		startRTCOscillator(raw_data[0]);
+		return 0;
+	}
+
 	// Parse raw data
-	uint32_t seconds = (raw_data[0] & 0xF) + 10*((raw_data[0] & 0x70) >> 4);
-	uint32_t minutes = (raw_data[1] & 0xF) + 10*((raw_data[1] & 0x70) >> 4);
-	uint32_t hour = (raw_data[2] & 0xF) + 10*((raw_data[2] & 0x10) >> 4);
-	uint32_t date = (raw_data[4] & 0xf)+ 10*((raw_data[4] & 0x30) >> 4);
-	uint32_t month = (raw_data[5] & 0xF) + 10*((raw_data[5] & 0x10) >> 4);
-	uint32_t year = (raw_data[6] & 0xF) + 10*((raw_data[6] & 0xF0) >> 4);
-
-	Serial.println(seconds);
-	Serial.print("Osc: ");
-	Serial.println(raw_data[3] & (1 << 5));
-	Serial.println(raw_data[0] & (1 << 7));
-
-	//Serial.println(minutes);
-	//Serial.println(hour);
-	//Serial.println(date);
-	//Serial.println(month);
-	//Serial.println(year);
+	uint32_t seconds = fromBCD(raw_data[0] & 0x7F);
+	uint32_t minutes = fromBCD(raw_data[1] & 0x7F);
+	uint32_t hour = fromBCD(raw_data[2] & 0x3F);
+	uint32_t date = fromBCD(raw_data[4] & 0x3F);
+	uint32_t month = fromBCD(raw_data[5] & 0x1F);
+	uint32_t year = 2000 + fromBCD(raw_data[6]);
 
 	// Time is seconds since January 1st, 1970
-	uint32_t current_time = seconds;
-	current_time += minutes * 60;
-	current_time += hour * 3600;
-	current_time += date * 86400;
-	current_time += month * 2592000;
-	current_time += year * 31104000; // TODO include leap year
+	return daysFromCivil(year, month, date) * 86400 + hour * 3600 + minutes * 60 + seconds;
+}
 
-	startRTCOscillator();
+void setRTCAlarm(uint8_t seconds, uint8_t minutes, uint8_t hour, 
+	uint8_t weekday, uint8_t date, uint8_t month)
+{
+	// Writing the weekday register also clears the old alarm flag
+	// Polarity bit is 0, so MFP is driven low on a match
+	Wire.beginTransmission(MCP7940_ADDRESS);
+	Wire.write(byte(MCP7940_ALM0_SECONDS));
+	Wire.write(toBCD(seconds) & 0x7F);
+	Wire.write(toBCD(minutes) & 0x7F);
+	Wire.write(toBCD(hour) & 0x3F); // 24 hour mode
+	Wire.write(MCP7940_ALM0_MASK_ALL | (weekday & 0x7));
+	Wire.write(toBCD(date) & 0x3F);
+	Wire.write(toBCD(month) & 0x1F);
+	Wire.endTransmission();
 
-	return current_time;
-}
\ No newline at end of file
+	Wire.beginTransmission(MCP7940_ADDRESS);
+	Wire.write(byte(MCP7940_CONTROL_REG));
+	Wire.write(MCP7940_CONTROL_OUT | MCP7940_CONTROL_ALM0EN);
+	Wire.endTransmission();
+}
+
+void setRTCAlarmEpoch(uint32_t time)
+{
+	uint32_t days = time / 86400;
+	uint32_t seconds_of_day = time % 86400;
+
+	uint16_t year;
+	uint8_t month;
+	uint8_t date;
+	civilFromDays(days, &year, &month, &date);
+
+	setRTCAlarm(seconds_of_day % 60, (seconds_of_day / 60) % 60, seconds_of_day / 3600,
+		(days + 4) % 7 + 1, date, month);
+}
+
+void clearRTCAlarm(void)
+{
+	Wire.beginTransmission(MCP7940_ADDRESS);
+	Wire.write(byte(MCP7940_CONTROL_REG));
+	Wire.write(MCP7940_CONTROL_OUT);
+	Wire.endTransmission();
+
+	Wire.beginTransmission(MCP7940_ADDRESS);
+	Wire.write(byte(MCP7940_ALM0_WKDAY));
+	Wire.write(MCP7940_ALM0_MASK_ALL);
+	Wire.endTransmission();
+}
+
+uint8_t RTCAlarmFired(void)
+{
+	return (readRTCRegister(MCP7940_ALM0_WKDAY) & MCP7940_ALM0_IF) ? 1 : 0;
+}
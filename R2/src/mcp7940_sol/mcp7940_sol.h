@@ -25,11 +25,39 @@
 
 #define MCP7940_CALIBRATION		0x08
 
+#define MCP7940_ALM0_SECONDS	0x0A
+
+#define MCP7940_ALM0_WKDAY		0x0D
+
+// Seconds register bits
+#define MCP7940_SECONDS_ST		(1 << 7)
+
+// Control register bits
+#define MCP7940_CONTROL_OUT		(1 << 7)
+#define MCP7940_CONTROL_ALM0EN	(1 << 4)
+
+// Alarm weekday register bits
+#define MCP7940_ALM0_MASK_ALL	(0x7 << 4)
+#define MCP7940_ALM0_IF			(1 << 3)
+
 void RTCSetup(void);
 
-void setRTCTime(uint8_t seconds, uint8_t minutes, uint8_t hour, uint8_t date, uint8_t month, uint16_t year);
+void setRTCTime(uint8_t seconds, uint8_t minutes, uint8_t hour, uint8_t weekday, uint8_t date, uint8_t month, uint16_t year);
 
+// Time is seconds since January 1st, 1970, valid for 2000 - 2099
+void setRTCEpoch(uint32_t time);
+
+// Returns 0 if the oscillator had stopped and the time was lost
 uint32_t getRTCTime(void);
 
+// Alarm 0 drives MFP low when every field matches. MFP is open drain and needs a pull-up
+void setRTCAlarm(uint8_t seconds, uint8_t minutes, uint8_t hour, uint8_t weekday, uint8_t date, uint8_t month);
+
+void setRTCAlarmEpoch(uint32_t time);
+
+void clearRTCAlarm(void);
+
+uint8_t RTCAlarmFired(void);
+
 
 #endif
\ No newline at end of file
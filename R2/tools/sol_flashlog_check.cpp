@@ -0,0 +1,266 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file sol_flashlog_check.cpp
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Randomized check of SOL_flashlog.h on a PC, against a simple model of the log
+ *
+ * 	Appends, drops and remounts at random, wrapping the log many times, and cuts off
+ * 	appends and sector starts part way like a power loss would. Appends are also made from
+ * 	a stale copy of the log position, like a wake that was cut off before saving it. After
+ * 	every step each record the log reports must read back as the model expects.
+ *
+ * 	Usage:
+ * 	g++ -std=gnu++11 -I../../common/src/SOL_core sol_flashlog_check.cpp -o sol_flashlog_check
+ * 	./sol_flashlog_check [iterations] [seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <deque>
+
+#include "SOL_flashfile.h"
+#include "SOL_flashlog.h"
+
+#define CHECK_DEFAULT_ITERATIONS			200000
+#define CHECK_DEFAULT_SEED					1
+
+/**
+ * @brief What the model expects at one position in the log
+ */
+typedef struct check_expect_t
+{
+	uint32_t value;
+	uint8_t torn;					// Written part way, may fail its CRC
+	uint32_t torn_value;			// Value as far as it was written, read back if the CRC still matches
+} check_expect_t;
+
+/**
+ * @brief A record the size of a small data packet
+ */
+typedef struct check_small_t
+{
+	uint32_t value;
+	uint8_t pad[40];
+} check_small_t;
+
+/**
+ * @brief A record that does not divide the sector evenly
+ */
+typedef struct check_large_t
+{
+	uint32_t value;
+	uint8_t pad[93];
+} check_large_t;
+
+static unsigned long failures = 0;
+
+#define CHECK(cond, iteration) \
+	do { if(!(cond)) { printf("  failed at step %d: %s (line %d)\n", (iteration), #cond, __LINE__); failures++; return; } } while(0)
+
+/**
+ * @brief Fills a record with a value, leaving no bytes erased so a torn write always shows
+ *
+ * @param record Pointer to the record
+ * @param value The value
+ */
+template<class Record>
+static void check_fill(Record * record, uint32_t value)
+{
+	memset(record, 0x5A, sizeof(Record));
+	record->value = value;
+}
+
+/**
+ * @brief Runs the randomized check on one flash geometry and record size
+ *
+ * @param name Name printed with the result
+ * @param path Path of the file backing the flash
+ * @param iterations The number of random steps
+ * @param seed Seed for rand
+ */
+template<class Flash, class Record>
+static void check_run(const char * name, const char * path, int iterations, unsigned seed)
+{
+	const uint32_t slots = SOL_flashlogSlots<Flash, Record>();
+	unsigned long before = failures;
+
+	unlink(path);
+	if(!Flash::open(path))
+	{
+		printf("%s: could not open %s\n", name, path);
+		failures++;
+		return;
+	}
+
+	SOL_flashlog_t log;
+	memset(&log, 0, sizeof(log));
+	CHECK((SOL_flashlogMount<Flash, Record>(&log)), 0);
+	CHECK((SOL_flashlogCount<Flash, Record>(&log) == 0), 0);
+
+	const uint32_t capacity = SOL_flashlogCapacity<Flash, Record>(&log);
+	std::deque<check_expect_t> model;
+	uint32_t next = 0;
+	srand(seed);
+
+	for(int it = 0; it < iterations; it++)
+	{
+		int op = rand() % 100;
+		Record record;
+
+		if(op < 55)
+		{
+			check_fill(&record, next);
+			CHECK((SOL_flashlogAppend<Flash, Record>(&log, &record)), it);
+			model.push_back({next++, 0, 0});
+		}
+		else if(op < 75)
+		{
+			uint32_t count = SOL_flashlogCount<Flash, Record>(&log);
+			if(count > 0)
+			{
+				uint32_t n = rand() % count + 1;
+				CHECK((SOL_flashlogDrop<Flash, Record>(&log, n)), it);
+				model.erase(model.begin(), model.begin() + n);
+			}
+		}
+		else if(op < 83)
+		{
+			// RTC memory lost, find everything again from the flash
+			memset(&log, 0, sizeof(log));
+			CHECK((SOL_flashlogMount<Flash, Record>(&log)), it);
+		}
+		else if(op < 90)
+		{
+			// Power lost part way through writing an entry
+			if(log.head_slot < slots)
+			{
+				SOL_flashlog_entry_t<Record> entry;
+				memset(&entry, 0xFF, sizeof(entry));
+				check_fill(&entry.record, next);
+				entry.crc = SOL_crc16((const uint8_t *) &entry.record, sizeof(Record));
+				uint32_t cut = 1 + rand() % (sizeof(entry) - 1);
+				CHECK(Flash::write(SOL_flashlogOffset<Flash, Record>(log.head_sector, log.head_slot), &entry, cut), it);
+
+				// Bytes that stay erased were never written, so only count the entry if some were not
+				uint8_t written = 0;
+				for(uint32_t i = 0; i < cut; i++)
+				{
+					written |= ((const uint8_t *) &entry)[i] != 0xFF;
+				}
+				if(written)
+				{
+					// A 16 bit CRC lets about one in 65536 torn entries through as they were written
+					memset((uint8_t *) &entry + cut, 0xFF, sizeof(entry) - cut);
+					model.push_back({next, 1, entry.record.value});
+				}
+				next++;
+
+				memset(&log, 0, sizeof(log));
+				CHECK((SOL_flashlogMount<Flash, Record>(&log)), it);
+			}
+		}
+		else if(op < 97)
+		{
+			// A wake appended but was cut off before saving the log position
+			SOL_flashlog_t stale = log;
+			check_fill(&record, next);
+			CHECK((SOL_flashlogAppend<Flash, Record>(&log, &record)), it);
+			model.push_back({next++, 0, 0});
+
+			log = stale;
+			check_fill(&record, next);
+			CHECK((SOL_flashlogAppend<Flash, Record>(&log, &record)), it);
+			model.push_back({next++, 0, 0});
+		}
+		else
+		{
+			// Power lost between erasing the next sector and writing its header
+			if(log.head_slot == slots)
+			{
+				CHECK(Flash::eraseSector((log.head_sector + 1) % log.sectors), it);
+				memset(&log, 0, sizeof(log));
+				CHECK((SOL_flashlogMount<Flash, Record>(&log)), it);
+			}
+		}
+
+		// A full log or a lost sector only ever loses the oldest records, and never more than the
+		// capacity until the head sector fills
+		uint32_t count = SOL_flashlogCount<Flash, Record>(&log);
+		CHECK(count <= model.size(), it);
+		CHECK(model.size() - count <= ((model.size() > capacity) ? model.size() - capacity : 0), it);
+		while(model.size() > count)
+		{
+			model.pop_front();
+		}
+
+		for(uint32_t idx = 0; idx < count; idx++)
+		{
+			uint8_t read = SOL_flashlogPeek<Flash, Record>(&log, idx, &record);
+			if(model[idx].torn)
+			{
+				CHECK(!read || record.value == model[idx].value || record.value == model[idx].torn_value, it);
+			}
+			else
+			{
+				CHECK(read && record.value == model[idx].value, it);
+			}
+		}
+	}
+
+	// Formatting empties the log, and it stays empty after a remount
+	CHECK((SOL_flashlogFormat<Flash, Record>(&log)), iterations);
+	CHECK((SOL_flashlogCount<Flash, Record>(&log) == 0), iterations);
+	memset(&log, 0, sizeof(log));
+	CHECK((SOL_flashlogMount<Flash, Record>(&log)), iterations);
+	CHECK((SOL_flashlogCount<Flash, Record>(&log) == 0), iterations);
+
+	// Records of another size are never read back
+	Record record;
+	check_fill(&record, 0);
+	CHECK((SOL_flashlogAppend<Flash, Record>(&log, &record)), iterations);
+	SOL_flashlog_t other;
+	memset(&other, 0, sizeof(other));
+	CHECK((SOL_flashlogMount<Flash, check_expect_t>(&other)), iterations);
+	CHECK((SOL_flashlogCount<Flash, check_expect_t>(&other) == 0), iterations);
+
+	Flash::close();
+	unlink(path);
+	printf("%s: %u records per sector, %u capacity, %s\n", name, slots, capacity, (failures == before) ? "ok" : "FAILED");
+}
+
+int main(int argc, char ** argv)
+{
+	int iterations = (argc > 1) ? atoi(argv[1]) : CHECK_DEFAULT_ITERATIONS;
+	unsigned seed = (argc > 2) ? (unsigned) atoi(argv[2]) : CHECK_DEFAULT_SEED;
+
+	check_run<SOL_flashfile<512, 6>, check_small_t>("512 B x 6 sectors", "sol_flashlog_check_a.bin", iterations, seed);
+	check_run<SOL_flashfile<4096, 3>, check_large_t>("4096 B x 3 sectors", "sol_flashlog_check_b.bin", iterations, seed);
+	check_run<SOL_flashfile<1024, 2>, check_small_t>("1024 B x 2 sectors", "sol_flashlog_check_c.bin", iterations, seed);
+
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,240 @@
+#!/usr/bin/env python3
+"""
+Builds SOL_V2 firmware deltas and serves them, standing in for the upload server.
+
+A delta rebuilds the new image from the image running on the unit, so a unit only
+downloads what changed. The format is read by SOL_ota.cpp:
+
+    header  "SOLD", source size, source SHA-256, target size, target SHA-256
+    COPY    0x01, source offset, length         copy bytes from the running image
+    INSERT  0x02, length, bytes                 bytes that are not in the running image
+
+All integers are 32 bit little endian.
+
+The server answers the same resources as the real one, so a unit pointed at it uploads
+as usual. When a unit reports the base firmware version, upload responses offer the
+update, and the unit fetches the delta from SOL_OTA_RESOURCE a few chunks per session.
+
+Usage:
+    python3 sol_ota_server.py diff old.bin new.bin patch.sold
+    python3 sol_ota_server.py apply old.bin patch.sold new.bin
+    python3 sol_ota_server.py serve old.bin 1 new.bin 2 [--port 8080] [--fail-rate 0.2]
+"""
+
+import argparse
+import hashlib
+import json
+import random
+import struct
+import sys
+from http.server import BaseHTTPRequestHandler, HTTPServer
+
+MAGIC = b"SOLD"
+HEADER_FORMAT = "<4sI32sI32s"
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+OP_COPY = 0x01
+OP_INSERT = 0x02
+
+MATCH_KEY = 16          # Bytes indexed at every source offset
+MIN_COPY = 24           # Shorter matches cost more as a COPY than as inserted bytes
+
+
+def match_length(source, src, target, tgt):
+    """Number of equal bytes at source[src:] and target[tgt:]"""
+    limit = min(len(source) - src, len(target) - tgt)
+    n = 0
+    step = 256
+    while n + step <= limit and source[src + n:src + n + step] == target[tgt + n:tgt + n + step]:
+        n += step
+    while n < limit and source[src + n] == target[tgt + n]:
+        n += 1
+    return n
+
+
+def diff(source, target):
+    """Greedy delta of target against source"""
+    index = {}
+    for i in range(len(source) - MATCH_KEY + 1):
+        index.setdefault(source[i:i + MATCH_KEY], i)
+
+    out = bytearray(struct.pack(HEADER_FORMAT, MAGIC, len(source), hashlib.sha256(source).digest(),
+                                len(target), hashlib.sha256(target).digest()))
+    pending = bytearray()
+
+    def flush():
+        if pending:
+            out.extend(struct.pack("<BI", OP_INSERT, len(pending)))
+            out.extend(pending)
+            pending.clear()
+
+    tgt = 0
+    next_src = 0        # Where the last copy left off, code that changed in place continues there
+    while tgt < len(target):
+        best_src, best_len = 0, 0
+        if next_src < len(source):
+            best_src, best_len = next_src, match_length(source, next_src, target, tgt)
+        if best_len < MIN_COPY:
+            src = index.get(target[tgt:tgt + MATCH_KEY])
+            if src is not None:
+                length = match_length(source, src, target, tgt)
+                if length > best_len:
+                    best_src, best_len = src, length
+
+        if best_len >= MIN_COPY:
+            flush()
+            out.extend(struct.pack("<BII", OP_COPY, best_src, best_len))
+            tgt += best_len
+            next_src = best_src + best_len
+        else:
+            pending.append(target[tgt])
+            tgt += 1
+            next_src += 1
+    flush()
+    return bytes(out)
+
+
+def apply(source, patch):
+    """Rebuilds the target from source and a delta, checking both hashes"""
+    magic, source_size, source_hash, target_size, target_hash = struct.unpack_from(HEADER_FORMAT, patch)
+    if magic != MAGIC:
+        raise ValueError("not a SOL delta")
+    if source_size > len(source) or hashlib.sha256(source[:source_size]).digest() != source_hash:
+        raise ValueError("delta is for another source image")
+
+    target = bytearray()
+    pos = HEADER_SIZE
+    while pos < len(patch):
+        op = patch[pos]
+        if op == OP_COPY:
+            src, length = struct.unpack_from("<II", patch, pos + 1)
+            if src + length > source_size:
+                raise ValueError("copy past the end of the source at %u" % pos)
+            target.extend(source[src:src + length])
+            pos += 9
+        elif op == OP_INSERT:
+            (length,) = struct.unpack_from("<I", patch, pos + 1)
+            target.extend(patch[pos + 5:pos + 5 + length])
+            pos += 5 + length
+        else:
+            raise ValueError("unknown op 0x%02X at %u" % (op, pos))
+
+    if len(target) != target_size or hashlib.sha256(target).digest() != target_hash:
+        raise ValueError("rebuilt image does not match")
+    return bytes(target)
+
+
+class UpdateServer(BaseHTTPRequestHandler):
+    """Acknowledges uploads and serves one delta, from base_version to version"""
+
+    patch = b""
+    base_version = 0
+    version = 0
+    fail_rate = 0.0
+
+    def reply(self, body, content_type="application/json"):
+        self.send_response(200)
+        self.send_header("Content-Type", content_type)
+        self.send_header("Content-Length", str(len(body)))
+        self.send_header("Connection", "close")
+        self.end_headers()
+        self.wfile.write(body)
+
+    def offer(self, request):
+        if request.get("fw") == self.base_version:
+            return {"version": self.version, "size": len(self.patch)}
+        return None
+
+    def do_POST(self):
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        try:
+            request = json.loads(body)
+        except ValueError:
+            self.send_error(400)
+            return
+
+        if self.path.endswith("/ota"):
+            if request.get("version") != self.version:
+                self.send_error(404)
+                return
+            if random.random() < self.fail_rate:
+                # Dropped mid transfer, the unit asks for the chunk again later
+                self.close_connection = True
+                return
+            offset = request.get("offset", 0)
+            chunk = self.patch[offset:offset + request.get("length", 0)]
+            print("unit %s: chunk at %u, %u of %u bytes" % (request.get("ID"), offset, offset + len(chunk), len(self.patch)))
+            self.reply(chunk, "application/octet-stream")
+            return
+
+        response = {}
+        if "records" in request:
+            seqs = [r["seq"] for r in request["records"]]
+            response["ack"] = max(seqs) if seqs else 0
+            print("unit %s: %u records, firmware %s" % (request.get("ID"), len(seqs), request.get("fw")))
+        elif "summaries" in request:
+            days = [s["day"] for s in request["summaries"]]
+            response["ack"] = max(days) if days else 0
+
+        offer = self.offer(request)
+        if offer is not None:
+            response["ota"] = offer
+        self.reply(json.dumps(response, separators=(",", ":")).encode())
+
+    def log_message(self, fmt, *args):
+        pass
+
+
+def read(path):
+    with open(path, "rb") as f:
+        return f.read()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("diff", help="build a delta")
+    p.add_argument("source")
+    p.add_argument("target")
+    p.add_argument("patch")
+
+    p = sub.add_parser("apply", help="rebuild an image from a delta, as a unit would")
+    p.add_argument("source")
+    p.add_argument("patch")
+    p.add_argument("target")
+
+    p = sub.add_parser("serve", help="stand in for the upload server, offering one update")
+    p.add_argument("source")
+    p.add_argument("source_version", type=int, help="SOL_FIRMWARE_VERSION of the source image")
+    p.add_argument("target")
+    p.add_argument("target_version", type=int, help="SOL_FIRMWARE_VERSION of the target image")
+    p.add_argument("--port", type=int, default=80)
+    p.add_argument("--fail-rate", type=float, default=0.0, help="fraction of chunk requests to drop")
+
+    args = parser.parse_args()
+
+    if args.command == "diff":
+        source, target = read(args.source), read(args.target)
+        patch = diff(source, target)
+        apply(source, patch)
+        with open(args.patch, "wb") as f:
+            f.write(patch)
+        print("%u byte delta for a %u byte image" % (len(patch), len(target)))
+    elif args.command == "apply":
+        target = apply(read(args.source), read(args.patch))
+        with open(args.target, "wb") as f:
+            f.write(target)
+        print("rebuilt %u bytes, hash verified" % len(target))
+    else:
+        source, target = read(args.source), read(args.target)
+        UpdateServer.patch = diff(source, target)
+        UpdateServer.base_version = args.source_version
+        UpdateServer.version = args.target_version
+        UpdateServer.fail_rate = args.fail_rate
+        print("serving %u byte delta, firmware %u to %u, on port %u"
+              % (len(UpdateServer.patch), args.source_version, args.target_version, args.port))
+        HTTPServer(("", args.port), UpdateServer).serve_forever()
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""
+Decodes the SOL_V2 binary trace log.
+
+Reads either the serial dump (lines starting with "T:", printed on touch wakeup)
+or an uploaded trace (JSON with a "trace" hex string, or the bare hex string).
+Event IDs and formats are read from SOL_trace.h, so this never goes out of date.
+
+Usage:
+    python3 sol_trace_decode.py capture.txt
+    python3 sol_trace_decode.py < capture.txt
+"""
+
+import json
+import os
+import re
+import struct
+import sys
+
+SRC_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src", "SOL_V2")
+
+EVENT_FORMAT = "<BBHIII"
+EVENT_SIZE = struct.calcsize(EVENT_FORMAT)
+LEVELS = {1: "ERROR", 2: "WARN", 3: "INFO", 4: "DEBUG"}
+
+
+def load_event_formats(path):
+    """Map of event ID to format string, from the enum in SOL_trace.h"""
+    formats = {}
+    pattern = re.compile(r'^\s*SOL_TRACE_(\w+)\s*=\s*(\d+)\s*,?\s*//\s*"(.*)"')
+    with open(path) as f:
+        for line in f:
+            m = pattern.match(line)
+            if m:
+                formats[int(m.group(2))] = (m.group(1), m.group(3))
+    return formats
+
+
+def load_phase_names(path):
+    """Phase names in enum order, from SOL_phase.h"""
+    names = []
+    pattern = re.compile(r'^\s*SOL_PHASE_(\w+)')
+    with open(path) as f:
+        for line in f:
+            m = pattern.match(line)
+            if m and m.group(1) != "COUNT":
+                names.append(m.group(1).lower())
+    return names
+
+
+def format_arg(spec, value, phases):
+    if spec == "f":
+        return "%.3f" % struct.unpack("<f", struct.pack("<I", value))[0]
+    if spec == "d":
+        return str(struct.unpack("<i", struct.pack("<I", value))[0])
+    if spec == "x":
+        return "0x%08X" % value
+    if spec == "p":
+        phase = value & 0xFF
+        name = phases[phase] if phase < len(phases) else str(phase)
+        return "%s @ %u MHz" % (name, value >> 8)
+    return str(value)
+
+
+def render(fmt, args, phases):
+    out = []
+    arg_idx = 0
+    i = 0
+    while i < len(fmt):
+        if fmt[i] == "%" and i + 1 < len(fmt) and arg_idx < len(args):
+            out.append(format_arg(fmt[i + 1], args[arg_idx], phases))
+            arg_idx += 1
+            i += 2
+        else:
+            out.append(fmt[i])
+            i += 1
+    return "".join(out)
+
+
+def read_hex(text):
+    """Pulls the event bytes out of a serial capture, JSON upload or bare hex"""
+    text = text.strip()
+    if text.startswith("{"):
+        return bytes.fromhex(json.loads(text)["trace"])
+    lines = [l.strip()[2:] for l in text.splitlines() if l.strip().startswith("T:")]
+    if lines:
+        return bytes.fromhex("".join(lines))
+    return bytes.fromhex(text)
+
+
+def decode(raw, formats, phases):
+    for offset in range(0, len(raw) - EVENT_SIZE + 1, EVENT_SIZE):
+        event_id, level, wake, time_ms, a, b = struct.unpack_from(EVENT_FORMAT, raw, offset)
+        name, fmt = formats.get(event_id, ("UNKNOWN_%u" % event_id, "%x %x"))
+        yield "wake %5u %8u ms %-5s %s" % (wake, time_ms, LEVELS.get(level, "?"), render(fmt, (a, b), phases))
+
+
+def main():
+    formats = load_event_formats(os.path.join(SRC_DIR, "SOL_trace.h"))
+    phases = load_phase_names(os.path.join(SRC_DIR, "SOL_phase.h"))
+
+    if len(sys.argv) > 1:
+        with open(sys.argv[1]) as f:
+            text = f.read()
+    else:
+        text = sys.stdin.read()
+
+    for line in decode(read_hex(text), formats, phases):
+        print(line)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,201 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_board.h
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Firmware core shared by SOL and SOL_V2, specialized at compile time by a board traits struct
+ *
+ * 	Each board describes itself with a traits struct in its own header, and typedefs it as SOL_board:
+ *
+ * 	EEPROM_I2C_ADDRESS		I2C address of the EEPROM
+ * 	EEPROM_PAGE_SIZE		Bytes per EEPROM page, a write may not cross a page
+ * 	EEPROM_WRITE_MS			Time for the EEPROM to finish writing a page
+ * 	LOG_START, LOG_END		Data log region in EEPROM, LOG_END is one past the last usable byte
+ * 	HAS_RTC					true if the board has a real time clock
+ * 	DAC_STEPS				Number of DAC values in a sweep
+ * 	SWEEP_GAIN_COUNT		Number of ADC gains a full sweep is run at
+ * 	V_SCALE[], I_SCALE[]	Volts and amps per ADC count at each gain, see SOL_sweep.h
+ * 	readPointRaw()			Sets the DAC and reads raw voltage and current counts
+ *
+ * 	All of these are compile time constants or static functions, so every template here
+ * 	compiles down to straight code for its board.
+ */
+
+
+#ifndef SOL_board_h
+#define SOL_board_h
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#include "SOL_sweep.h"
+
+#define SOL_EEPROM_READ_CHUNK			32				// Bytes per EEPROM read request, fits the Wire buffer
+
+/**
+ * @brief Writes data to EEPROM, one transaction per page instead of per byte
+ *
+ * @param address The starting address in EEPROM to write to
+ * @param data Pointer to the data
+ * @param size The number of bytes to write
+ *
+ */
+template<class Board>
+void SOL_eepromWrite(uint16_t address, const uint8_t * data, uint16_t size)
+{
+	while(size > 0)
+	{
+		// Stop at the end of the page, the EEPROM would wrap around within it
+		uint16_t chunk = Board::EEPROM_PAGE_SIZE - (address % Board::EEPROM_PAGE_SIZE);
+		if(chunk > size)
+		{
+			chunk = size;
+		}
+
+		Wire.beginTransmission(Board::EEPROM_I2C_ADDRESS);
+		Wire.write((uint8_t) (address >> 8)); // MSB
+		Wire.write((uint8_t) (address & 0xFF)); // LSB
+		Wire.write(data, chunk);
+		Wire.endTransmission();
+		delay(Board::EEPROM_WRITE_MS);
+
+		address += chunk;
+		data += chunk;
+		size -= chunk;
+	}
+}
+
+/**
+ * @brief Reads data from EEPROM with sequential reads
+ *
+ * @param address The starting address in EEPROM to read from
+ * @param data Pointer to the data storage to read data into
+ * @param size The number of bytes to read
+ *
+ */
+template<class Board>
+void SOL_eepromRead(uint16_t address, uint8_t * data, uint16_t size)
+{
+	while(size > 0)
+	{
+		uint16_t chunk = (size > SOL_EEPROM_READ_CHUNK) ? SOL_EEPROM_READ_CHUNK : size;
+
+		Wire.beginTransmission(Board::EEPROM_I2C_ADDRESS);
+		Wire.write((uint8_t) (address >> 8)); // MSB
+		Wire.write((uint8_t) (address & 0xFF)); // LSB
+		Wire.endTransmission();
+
+		Wire.requestFrom(Board::EEPROM_I2C_ADDRESS, (int) chunk);
+		for(uint16_t i = 0; i < chunk; i++)
+		{
+			data[i] = Wire.read();
+		}
+
+		address += chunk;
+		data += chunk;
+		size -= chunk;
+	}
+}
+
+/**
+ * @brief Gets the number of records the data log can hold
+ *
+ * 	One slot is always left empty to tell a full log from an empty one
+ *
+ * @return The number of records
+ */
+template<class Board, class Record>
+constexpr uint16_t SOL_logCapacity(void)
+{
+	return (Board::LOG_END - Board::LOG_START) / sizeof(Record) - 1;
+}
+
+/**
+ * @brief Gets the address of the record after one in the data log, wrapping around
+ *
+ * @param address The address of a record
+ *
+ * @return The address of the next record
+ */
+template<class Board, class Record>
+uint16_t SOL_logNext(uint16_t address)
+{
+	address += sizeof(Record);
+	if(address + sizeof(Record) > Board::LOG_END)
+	{
+		address = Board::LOG_START;
+	}
+	return address;
+}
+
+/**
+ * @brief Gets the number of records between the tail and head of the data log
+ *
+ * @param head The address the next record will be written to
+ * @param tail The address of the oldest record
+ *
+ * @return The number of records
+ */
+template<class Board, class Record>
+uint16_t SOL_logCount(uint16_t head, uint16_t tail)
+{
+	const uint16_t span = SOL_logCapacity<Board, Record>() + 1;
+	uint16_t head_idx = (head - Board::LOG_START) / sizeof(Record);
+	uint16_t tail_idx = (tail - Board::LOG_START) / sizeof(Record);
+
+	return (head_idx + span - tail_idx) % span;
+}
+
+/**
+ * @brief Finds peak power, current and voltage with a full sweep at each gain
+ *
+ * @param max_power Pointer to put the peak power in, W
+ * @param max_current Pointer to put the peak current in, A
+ * @param max_voltage Pointer to put the peak voltage in, V
+ *
+ */
+template<class Board>
+void SOL_sweepFull(float * max_power, float * max_current, float * max_voltage)
+{
+	for(uint8_t gain_idx = 0; gain_idx < Board::SWEEP_GAIN_COUNT; gain_idx++)
+	{
+		// Maxima are kept in raw counts, converted once per gain
+		SOL_sweep_max_t max;
+		SOL_sweepMaxReset(&max);
+
+		for(uint16_t dac = 0; dac < Board::DAC_STEPS; dac++)
+		{
+			int16_t voltage_raw;
+			int16_t current_raw;
+			Board::readPointRaw(dac, gain_idx, gain_idx, &voltage_raw, &current_raw);
+			SOL_sweepMaxAdd(&max, voltage_raw, current_raw);
+		}
+
+		SOL_sweepMaxToUnits(&max, Board::V_SCALE[gain_idx], Board::I_SCALE[gain_idx], max_power, max_current, max_voltage);
+	}
+}
+
+#endif
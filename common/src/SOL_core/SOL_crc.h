@@ -0,0 +1,60 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_crc.h
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief CRC shared by the flash log and the stored configuration
+ */
+
+
+#ifndef SOL_crc_h
+#define SOL_crc_h
+
+#include <stdint.h>
+
+/**
+ * @brief CRC-16/CCITT of a block of bytes
+ *
+ * @param data Pointer to the bytes
+ * @param size The number of bytes
+ *
+ * @return The CRC
+ */
+static inline uint16_t SOL_crc16(const uint8_t * data, uint32_t size)
+{
+	uint16_t crc = 0xFFFF;
+	for(uint32_t i = 0; i < size; i++)
+	{
+		crc ^= (uint16_t) data[i] << 8;
+		for(uint8_t bit = 0; bit < 8; bit++)
+		{
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+#endif
@@ -0,0 +1,151 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_flashfile.h
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Flash traits for SOL_flashlog.h backed by a file, to run the log on a PC
+ *
+ * 	Erasing sets bytes to 0xFF and writing only clears bits, like NOR flash, so mistakes
+ * 	that would corrupt the log on a device also corrupt it here.
+ */
+
+
+#ifndef SOL_flashfile_h
+#define SOL_flashfile_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief File backed flash region, open one with SOL_flashfile::open before use
+ */
+template<uint32_t Sector_Size, uint32_t Sector_Count>
+struct SOL_flashfile
+{
+	static constexpr uint32_t SECTOR_SIZE = Sector_Size;
+
+	static FILE *& file(void) {static FILE * f = NULL; return f;}
+
+	/**
+	 * @brief Opens the file backing the region, creating it erased if it does not exist
+	 *
+	 * @param path The path of the file
+	 *
+	 * @return 1 if the file is open, otherwise 0
+	 */
+	static uint8_t open(const char * path)
+	{
+		close();
+		file() = fopen(path, "r+b");
+		if(file() == NULL)
+		{
+			file() = fopen(path, "w+b");
+			if(file() == NULL)
+			{
+				return 0;
+			}
+			for(uint32_t sector = 0; sector < Sector_Count; sector++)
+			{
+				if(!eraseSector(sector))
+				{
+					return 0;
+				}
+			}
+		}
+		return 1;
+	}
+
+	static void close(void)
+	{
+		if(file() != NULL)
+		{
+			fclose(file());
+			file() = NULL;
+		}
+	}
+
+	static uint32_t size(void)
+	{
+		return Sector_Size * Sector_Count;
+	}
+
+	static uint8_t read(uint32_t offset, void * data, uint32_t size)
+	{
+		if(file() == NULL || offset + size > Sector_Size * Sector_Count)
+		{
+			return 0;
+		}
+		return fseek(file(), offset, SEEK_SET) == 0 && fread(data, 1, size, file()) == size;
+	}
+
+	static uint8_t write(uint32_t offset, const void * data, uint32_t size)
+	{
+		uint8_t current[64];
+		const uint8_t * bytes = (const uint8_t *) data;
+		while(size > 0)
+		{
+			uint32_t chunk = (size > sizeof(current)) ? sizeof(current) : size;
+			if(!read(offset, current, chunk))
+			{
+				return 0;
+			}
+			for(uint32_t i = 0; i < chunk; i++)
+			{
+				current[i] &= bytes[i];
+			}
+			if(fseek(file(), offset, SEEK_SET) != 0 || fwrite(current, 1, chunk, file()) != chunk)
+			{
+				return 0;
+			}
+			offset += chunk;
+			bytes += chunk;
+			size -= chunk;
+		}
+		return fflush(file()) == 0;
+	}
+
+	static uint8_t eraseSector(uint32_t sector)
+	{
+		uint8_t erased[64];
+		memset(erased, 0xFF, sizeof(erased));
+		if(file() == NULL || sector >= Sector_Count || fseek(file(), sector * Sector_Size, SEEK_SET) != 0)
+		{
+			return 0;
+		}
+		for(uint32_t done = 0; done < Sector_Size; done += sizeof(erased))
+		{
+			uint32_t chunk = (Sector_Size - done > sizeof(erased)) ? sizeof(erased) : Sector_Size - done;
+			if(fwrite(erased, 1, chunk, file()) != chunk)
+			{
+				return 0;
+			}
+		}
+		return fflush(file()) == 0;
+	}
+};
+
+#endif
@@ -0,0 +1,525 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_flashlog.h
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Append only record log for NOR flash, specialized at compile time by a flash traits struct
+ *
+ * 	The log fills sectors in turn around the region, so every sector is erased once per lap, which
+ * 	spreads wear evenly. Each sector starts with a header holding a sequence number, so the newest
+ * 	sector can be found after power loss. Each entry holds a CRC, so a write cut short is detected,
+ * 	and an acknowledged byte, cleared once the record has been uploaded. Flash bits only go from 1
+ * 	to 0 without an erase, so entries are written once and only the acknowledged byte changes later.
+ *
+ * 	A flash traits struct describes the storage:
+ *
+ * 	SECTOR_SIZE				Bytes per erase sector
+ * 	size()					Bytes in the flash region, a multiple of SECTOR_SIZE
+ * 	read()					Reads bytes at an offset in the region
+ * 	write()					Writes bytes at an offset, only clearing bits like NOR flash
+ * 	eraseSector()			Sets every byte of a sector to 0xFF
+ *
+ * 	See SOL_flashfile.h for a file backed implementation, to run the log on a PC, and
+ * 	R2/tools/sol_flashlog_check.cpp for a randomized check of the log built on it.
+ */
+
+
+#ifndef SOL_flashlog_h
+#define SOL_flashlog_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "SOL_crc.h"
+
+#define SOL_FLASHLOG_MAGIC				0x534F4C31UL		// "SOL1"
+#define SOL_FLASHLOG_READ_CHUNK			64					// Bytes checked at a time when looking for erased entries
+
+/**
+ * @brief Header at the start of each sector in use
+ */
+typedef struct SOL_flashlog_header_t
+{
+	uint32_t magic;
+	uint32_t seq;					// Increases by one for each sector started
+	uint16_t record_size;			// Records of another size are never read back
+	uint16_t reserved;
+} SOL_flashlog_header_t;
+
+/**
+ * @brief One record in the log
+ */
+template<class Record>
+struct SOL_flashlog_entry_t
+{
+	uint16_t crc;					// CRC of the record
+	uint8_t acked;					// 0xFF until the record has been acknowledged
+	uint8_t reserved;
+	Record record;
+};
+
+/**
+ * @brief Position of the log's head and tail, small enough to keep in RTC memory between mounts
+ */
+typedef struct SOL_flashlog_t
+{
+	uint32_t sectors;				// Sectors in the flash region
+	uint32_t head_sector;			// Sector being appended to
+	uint32_t head_slot;				// Next free entry in the head sector
+	uint32_t head_seq;				// Sequence number of the head sector
+	uint32_t tail_sector;			// Sector of the oldest record not acknowledged
+	uint32_t tail_slot;
+	uint8_t mounted;
+} SOL_flashlog_t;
+
+/**
+ * @brief Gets the number of entries that fit in a sector after its header
+ *
+ * @return The number of entries
+ */
+template<class Flash, class Record>
+constexpr uint32_t SOL_flashlogSlots(void)
+{
+	return (Flash::SECTOR_SIZE - sizeof(SOL_flashlog_header_t)) / sizeof(SOL_flashlog_entry_t<Record>);
+}
+
+/**
+ * @brief Gets the offset of an entry in the flash region
+ *
+ * @param sector The sector
+ * @param slot The entry in the sector
+ *
+ * @return The offset
+ */
+template<class Flash, class Record>
+uint32_t SOL_flashlogOffset(uint32_t sector, uint32_t slot)
+{
+	return sector * Flash::SECTOR_SIZE + sizeof(SOL_flashlog_header_t) + slot * sizeof(SOL_flashlog_entry_t<Record>);
+}
+
+/**
+ * @brief Checks if a range of flash is erased
+ *
+ * @param offset The offset of the range
+ * @param size The number of bytes
+ *
+ * @return 1 if every byte is 0xFF, otherwise 0
+ */
+template<class Flash>
+uint8_t SOL_flashlogErased(uint32_t offset, uint32_t size)
+{
+	uint8_t buffer[SOL_FLASHLOG_READ_CHUNK];
+	while(size > 0)
+	{
+		uint32_t chunk = (size > SOL_FLASHLOG_READ_CHUNK) ? SOL_FLASHLOG_READ_CHUNK : size;
+		if(!Flash::read(offset, buffer, chunk))
+		{
+			return 0;
+		}
+		for(uint32_t i = 0; i < chunk; i++)
+		{
+			if(buffer[i] != 0xFF)
+			{
+				return 0;
+			}
+		}
+		offset += chunk;
+		size -= chunk;
+	}
+	return 1;
+}
+
+/**
+ * @brief Reads a sector header, checking it belongs to a log of this record size
+ *
+ * @param sector The sector
+ * @param seq Pointer to put the sector's sequence number in
+ *
+ * @return 1 if the sector is in use by the log, otherwise 0
+ */
+template<class Flash, class Record>
+uint8_t SOL_flashlogReadHeader(uint32_t sector, uint32_t * seq)
+{
+	SOL_flashlog_header_t header;
+	if(!Flash::read(sector * Flash::SECTOR_SIZE, &header, sizeof(header)))
+	{
+		return 0;
+	}
+
+	*seq = header.seq;
+	return header.magic == SOL_FLASHLOG_MAGIC && header.record_size == sizeof(Record);
+}
+
+/**
+ * @brief Erases a sector and starts it as the new head of the log
+ *
+ * @param log Pointer to the log
+ * @param sector The sector
+ * @param seq The sequence number of the sector
+ *
+ * @return 1 if the sector was started, otherwise 0
+ */
+template<class Flash, class Record>
+uint8_t SOL_flashlogStartSector(SOL_flashlog_t * log, uint32_t sector, uint32_t seq)
+{
+	// Move the head first, so a write cut short is found again on the next mount
+	log->head_sector = sector;
+	log->head_slot = 0;
+	log->head_seq = seq;
+
+	SOL_flashlog_header_t header;
+	header.magic = SOL_FLASHLOG_MAGIC;
+	header.seq = seq;
+	header.record_size = sizeof(Record);
+	header.reserved = 0xFFFF;
+
+	return Flash::eraseSector(sector) && Flash::write(sector * Flash::SECTOR_SIZE, &header, sizeof(header));
+}
+
+/**
+ * @brief Empties the log, erasing every sector the old log used
+ *
+ * @param log Pointer to the log
+ *
+ * @return 1 if the log was emptied, otherwise 0
+ */
+template<class Flash, class Record>
+uint8_t SOL_flashlogFormat(SOL_flashlog_t * log)
+{
+	log->sectors = Flash::size() / Flash::SECTOR_SIZE;
+	log->mounted = 0;
+
+	if(log->sectors < 2)
+	{
+		return 0;
+	}
+
+	// Continue from the newest sequence number, so no old sector looks newer
+	uint32_t seq = 0;
+	for(uint32_t sector = 0; sector < log->sectors; sector++)
+	{
+		SOL_flashlog_header_t header;
+		if(Flash::read(sector * Flash::SECTOR_SIZE, &header, sizeof(header)) && header.magic == SOL_FLASHLOG_MAGIC && header.seq > seq)
+		{
+			seq = header.seq;
+		}
+	}
+
+	if(!SOL_flashlogStartSector<Flash, Record>(log, 0, seq + 1))
+	{
+		return 0;
+	}
+
+	// Invalidate every other sector of the old log
+	for(uint32_t sector = 1; sector < log->sectors; sector++)
+	{
+		uint32_t sector_seq;
+		if(SOL_flashlogReadHeader<Flash, Record>(sector, &sector_seq) && !Flash::eraseSector(sector))
+		{
+			return 0;
+		}
+	}
+
+	log->tail_sector = 0;
+	log->tail_slot = 0;
+	log->mounted = 1;
+	return 1;
+}
+
+/**
+ * @brief Finds the head and tail of the log by scanning the flash, formatting it if no log is found
+ *
+ * @param log Pointer to the log
+ *
+ * @return 1 if the log is ready, otherwise 0
+ */
+template<class Flash, class Record>
+uint8_t SOL_flashlogMount(SOL_flashlog_t * log)
+{
+	const uint32_t slots = SOL_flashlogSlots<Flash, Record>();
+	log->sectors = Flash::size() / Flash::SECTOR_SIZE;
+	log->mounted = 0;
+
+	// The head is the sector with the newest sequence number
+	uint8_t found = 0;
+	for(uint32_t sector = 0; sector < log->sectors; sector++)
+	{
+		uint32_t seq;
+		if(SOL_flashlogReadHeader<Flash, Record>(sector, &seq) && (!found || seq > log->head_seq))
+		{
+			found = 1;
+			log->head_sector = sector;
+			log->head_seq = seq;
+		}
+	}
+
+	if(!found)
+	{
+		return SOL_flashlogFormat<Flash, Record>(log);
+	}
+
+	// First entry never written, entries are filled in order
+	log->head_slot = 0;
+	while(log->head_slot < slots
+		&& !SOL_flashlogErased<Flash>(SOL_flashlogOffset<Flash, Record>(log->head_sector, log->head_slot), sizeof(SOL_flashlog_entry_t<Record>)))
+	{
+		log->head_slot++;
+	}
+
+	// Records are acknowledged in order, so the tail follows the newest acknowledged entry.
+	// Walk back from the head through sectors with consecutive sequence numbers.
+	log->tail_sector = log->head_sector;
+	log->tail_slot = 0;
+	uint32_t sector = log->head_sector;
+	uint32_t seq = log->head_seq;
+	uint32_t end = log->head_slot;
+	for(uint32_t walked = 0; walked < log->sectors; walked++)
+	{
+		uint8_t acked_found = 0;
+		for(uint32_t slot = end; slot > 0; slot--)
+		{
+			uint8_t acked;
+			uint32_t offset = SOL_flashlogOffset<Flash, Record>(sector, slot - 1) + offsetof(SOL_flashlog_entry_t<Record>, acked);
+			if(Flash::read(offset, &acked, 1) && acked != 0xFF)
+			{
+				log->tail_sector = sector;
+				log->tail_slot = slot;
+				acked_found = 1;
+				break;
+			}
+		}
+		if(acked_found)
+		{
+			break;
+		}
+
+		// Nothing acknowledged here, so the tail is at least as old as this sector
+		log->tail_sector = sector;
+		log->tail_slot = 0;
+
+		uint32_t prev = (sector + log->sectors - 1) % log->sectors;
+		uint32_t prev_seq;
+		if(prev == log->head_sector || !SOL_flashlogReadHeader<Flash, Record>(prev, &prev_seq) || prev_seq != seq - 1)
+		{
+			break;
+		}
+		sector = prev;
+		seq = prev_seq;
+		end = slots;
+	}
+
+	// A tail at the end of a full sector is the start of the next one
+	if(log->tail_slot == slots && log->tail_sector != log->head_sector)
+	{
+		log->tail_sector = (log->tail_sector + 1) % log->sectors;
+		log->tail_slot = 0;
+	}
+
+	log->mounted = 1;
+	return 1;
+}
+
+/**
+ * @brief Gets the number of records the log holds before it can drop any
+ *
+ * 	One sector is always kept for the head, so a full log loses a sector of the oldest records at once
+ *
+ * @param log Pointer to the log
+ *
+ * @return The number of records
+ */
+template<class Flash, class Record>
+uint32_t SOL_flashlogCapacity(const SOL_flashlog_t * log)
+{
+	return (log->sectors - 1) * SOL_flashlogSlots<Flash, Record>();
+}
+
+/**
+ * @brief Gets the number of records not acknowledged yet
+ *
+ * @param log Pointer to the log
+ *
+ * @return The number of records
+ */
+template<class Flash, class Record>
+uint32_t SOL_flashlogCount(const SOL_flashlog_t * log)
+{
+	uint32_t sectors_between = (log->head_sector + log->sectors - log->tail_sector) % log->sectors;
+	return sectors_between * SOL_flashlogSlots<Flash, Record>() + log->head_slot - log->tail_slot;
+}
+
+/**
+ * @brief Appends a record, overwriting the oldest sector of records when the log is full
+ *
+ * @param log Pointer to the log
+ * @param record Pointer to the record
+ *
+ * @return 1 if the record was written, otherwise 0
+ */
+template<class Flash, class Record>
+uint8_t SOL_flashlogAppend(SOL_flashlog_t * log, const Record * record)
+{
+	const uint32_t slots = SOL_flashlogSlots<Flash, Record>();
+
+	if(!log->mounted && !SOL_flashlogMount<Flash, Record>(log))
+	{
+		return 0;
+	}
+
+	if(log->head_slot == slots)
+	{
+		uint32_t next = (log->head_sector + 1) % log->sectors;
+
+		// Started behind this copy of the head, erasing it again would lose what was written there
+		uint32_t next_seq;
+		if(SOL_flashlogReadHeader<Flash, Record>(next, &next_seq) && next_seq == log->head_seq + 1)
+		{
+			if(!SOL_flashlogMount<Flash, Record>(log))
+			{
+				return 0;
+			}
+			return SOL_flashlogAppend<Flash, Record>(log, record);
+		}
+
+		if(next == log->tail_sector)
+		{
+			// Full, drop the oldest sector
+			log->tail_sector = (next + 1) % log->sectors;
+			log->tail_slot = 0;
+		}
+
+		if(!SOL_flashlogStartSector<Flash, Record>(log, next, log->head_seq + 1))
+		{
+			log->mounted = 0;
+			return 0;
+		}
+	}
+
+	uint32_t offset = SOL_flashlogOffset<Flash, Record>(log->head_sector, log->head_slot);
+
+	// Written behind this copy of the head, e.g. by a wake that was cut off
+	if(!SOL_flashlogErased<Flash>(offset, sizeof(SOL_flashlog_entry_t<Record>)))
+	{
+		if(!SOL_flashlogMount<Flash, Record>(log))
+		{
+			return 0;
+		}
+		return SOL_flashlogAppend<Flash, Record>(log, record);
+	}
+
+	SOL_flashlog_entry_t<Record> entry;
+	memset(&entry, 0xFF, sizeof(entry));
+	entry.record = *record;
+	entry.crc = SOL_crc16((const uint8_t *) record, sizeof(Record));
+
+	log->head_slot++;
+	return Flash::write(offset, &entry, sizeof(entry));
+}
+
+/**
+ * @brief Reads a record that has not been acknowledged yet
+ *
+ * @param log Pointer to the log
+ * @param idx Index of the record, 0 is the oldest
+ * @param record Pointer to put the record in
+ *
+ * @return 1 if the record was read, 0 if it is past the head or failed its CRC
+ */
+template<class Flash, class Record>
+uint8_t SOL_flashlogPeek(const SOL_flashlog_t * log, uint32_t idx, Record * record)
+{
+	const uint32_t slots = SOL_flashlogSlots<Flash, Record>();
+
+	if(!log->mounted || idx >= SOL_flashlogCount<Flash, Record>(log))
+	{
+		return 0;
+	}
+
+	uint32_t position = log->tail_slot + idx;
+	uint32_t sector = (log->tail_sector + position / slots) % log->sectors;
+	uint32_t slot = position % slots;
+
+	SOL_flashlog_entry_t<Record> entry;
+	if(!Flash::read(SOL_flashlogOffset<Flash, Record>(sector, slot), &entry, sizeof(entry)))
+	{
+		return 0;
+	}
+
+	if(entry.crc != SOL_crc16((const uint8_t *) &entry.record, sizeof(Record)))
+	{
+		return 0;
+	}
+
+	*record = entry.record;
+	return 1;
+}
+
+/**
+ * @brief Acknowledges the oldest records, so they are never read back again
+ *
+ * 	Only the last record dropped is marked, the mount finds the tail after the newest mark
+ *
+ * @param log Pointer to the log
+ * @param count The number of records to drop
+ *
+ * @return 1 if the records were dropped, otherwise 0
+ */
+template<class Flash, class Record>
+uint8_t SOL_flashlogDrop(SOL_flashlog_t * log, uint32_t count)
+{
+	const uint32_t slots = SOL_flashlogSlots<Flash, Record>();
+
+	uint32_t available = SOL_flashlogCount<Flash, Record>(log);
+	if(!log->mounted || count == 0)
+	{
+		return log->mounted;
+	}
+	if(count > available)
+	{
+		count = available;
+	}
+
+	uint32_t position = log->tail_slot + count - 1;
+	uint32_t sector = (log->tail_sector + position / slots) % log->sectors;
+	uint32_t slot = position % slots;
+
+	uint8_t acked = 0x00;
+	uint32_t offset = SOL_flashlogOffset<Flash, Record>(sector, slot) + offsetof(SOL_flashlog_entry_t<Record>, acked);
+
+	// Move the tail to just past the marked entry, stepping to the next sector at its end
+	log->tail_sector = sector;
+	log->tail_slot = slot + 1;
+	if(log->tail_slot == slots && log->tail_sector != log->head_sector)
+	{
+		log->tail_sector = (log->tail_sector + 1) % log->sectors;
+		log->tail_slot = 0;
+	}
+
+	return Flash::write(offset, &acked, 1);
+}
+
+#endif
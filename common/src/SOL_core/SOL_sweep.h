@@ -0,0 +1,218 @@
+/*
+MIT License
+
+Copyright (c) 2018 by Jacob Wachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/**
+ * @file SOL_sweep.h
+ * @author agent
+ * @date 18 Oct 2026
+ * @brief Sweep arithmetic shared by SOL and SOL_V2, maxima are tracked in raw ADC counts
+ *
+ * 	Each board builds tables of volts and amps per count with the constexpr helpers here,
+ * 	one entry per ADC gain, so no division is left in the sweep loop. Maxima are tracked as
+ * 	integers and converted once per sweep.
+ */
+
+
+#ifndef SOL_sweep_h
+#define SOL_sweep_h
+
+#include <stdint.h>
+
+/**
+ * @brief Volts at the panel per ADC count
+ *
+ * @param adc_full_scale_v ADC input voltage at full scale
+ * @param adc_range ADC counts at full scale
+ * @param amplification Divider between the panel and the ADC input
+ *
+ * @return Volts per count
+ */
+constexpr float SOL_voltsPerCount(float adc_full_scale_v, uint16_t adc_range, float amplification)
+{
+	return adc_full_scale_v / adc_range * amplification;
+}
+
+/**
+ * @brief Amps through the panel per ADC count
+ *
+ * @param adc_full_scale_v ADC input voltage at full scale
+ * @param adc_range ADC counts at full scale
+ * @param r_sense Current sense resistance, Ohms
+ * @param amplification Amplification of the current sense voltage
+ *
+ * @return Amps per count
+ */
+constexpr float SOL_ampsPerCount(float adc_full_scale_v, uint16_t adc_range, float r_sense, float amplification)
+{
+	return adc_full_scale_v / adc_range / r_sense / amplification;
+}
+
+/**
+ * @brief Maxima of a sweep in raw ADC counts, all readings at one gain
+ */
+typedef struct SOL_sweep_max_t
+{
+	int32_t power;			// Voltage counts times current counts
+	int16_t current;
+	int16_t voltage;
+} SOL_sweep_max_t;
+
+/**
+ * @brief Clears sweep maxima before a sweep
+ *
+ * @param max Pointer to the maxima
+ *
+ */
+static inline void SOL_sweepMaxReset(SOL_sweep_max_t * max)
+{
+	max->power = 0;
+	max->current = 0;
+	max->voltage = 0;
+}
+
+/**
+ * @brief Adds one operating point to the sweep maxima
+ *
+ * @param max Pointer to the maxima
+ * @param voltage_raw The voltage reading
+ * @param current_raw The current reading
+ *
+ */
+static inline void SOL_sweepMaxAdd(SOL_sweep_max_t * max, int16_t voltage_raw, int16_t current_raw)
+{
+	int32_t power = (int32_t) voltage_raw * current_raw;
+
+	if(power > max->power)
+	{
+		max->power = power;
+	}
+
+	if(current_raw > max->current)
+	{
+		max->current = current_raw;
+	}
+
+	if(voltage_raw > max->voltage)
+	{
+		max->voltage = voltage_raw;
+	}
+}
+
+/**
+ * @brief Converts sweep maxima to engineering units, keeping the larger of them and the values passed in
+ *
+ * 	Lets maxima from sweeps at different gains be combined.
+ *
+ * @param max Pointer to the maxima
+ * @param volts_per_count Voltage scale at the gain of the sweep
+ * @param amps_per_count Current scale at the gain of the sweep
+ * @param max_power Pointer to the peak power, W
+ * @param max_current Pointer to the peak current, A
+ * @param max_voltage Pointer to the peak voltage, V
+ *
+ */
+static inline void SOL_sweepMaxToUnits(const SOL_sweep_max_t * max, float volts_per_count, float amps_per_count,
+	float * max_power, float * max_current, float * max_voltage)
+{
+	float power = max->power * (volts_per_count * amps_per_count);
+	float current = max->current * amps_per_count;
+	float voltage = max->voltage * volts_per_count;
+
+	if(power > *max_power) {*max_power = power;}
+	if(current > *max_current) {*max_current = current;}
+	if(voltage > *max_voltage) {*max_voltage = voltage;}
+}
+
+/**
+ * @brief Running mean and variance of repeated readings of one operating point
+ */
+typedef struct SOL_oversample_t
+{
+	uint16_t count;
+	float mean;
+	float m2;				// Sum of squared differences from the mean
+} SOL_oversample_t;
+
+/**
+ * @brief Clears an oversampling accumulator before reading a new point
+ *
+ * @param acc Pointer to the accumulator
+ *
+ */
+static inline void SOL_oversampleReset(SOL_oversample_t * acc)
+{
+	acc->count = 0;
+	acc->mean = 0.0;
+	acc->m2 = 0.0;
+}
+
+/**
+ * @brief Adds one reading to an oversampling accumulator
+ *
+ * @param acc Pointer to the accumulator
+ * @param raw The reading
+ *
+ */
+static inline void SOL_oversampleAdd(SOL_oversample_t * acc, int16_t raw)
+{
+	// Welford's update, stable without keeping the readings
+	acc->count++;
+	float delta = raw - acc->mean;
+	acc->mean += delta / acc->count;
+	acc->m2 += delta * (raw - acc->mean);
+}
+
+/**
+ * @brief Checks if the mean of the readings is known well enough to stop reading
+ *
+ * @param acc Pointer to the accumulator
+ * @param min_count Readings to take before stopping, at least 2
+ * @param tolerance Standard error of the mean to stop at, ADC counts
+ *
+ * @return 1 if the mean has converged, otherwise 0
+ */
+static inline uint8_t SOL_oversampleConverged(const SOL_oversample_t * acc, uint16_t min_count, float tolerance)
+{
+	if(acc->count < min_count || acc->count < 2)
+	{
+		return 0;
+	}
+
+	// Variance of the mean is m2 / (n - 1) / n, compared squared to avoid a square root
+	return acc->m2 <= tolerance * tolerance * (acc->count - 1) * acc->count;
+}
+
+/**
+ * @brief Gets the mean of the readings, rounded to the nearest count
+ *
+ * @param acc Pointer to the accumulator
+ *
+ * @return The mean reading
+ */
+static inline int16_t SOL_oversampleMean(const SOL_oversample_t * acc)
+{
+	return (int16_t) (acc->mean + 0.5);
+}
+
+#endif